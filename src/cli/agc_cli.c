@@ -142,6 +142,23 @@ static void CliShowUsage(void)
     "\"core\" resume file or\n"
     "                         another file provided as a command "
     "line argument.\n"
+    "--batch=MANIFEST         Run the jobs listed in the JSON file "
+    "MANIFEST unthrottled\n"
+    "                         on all CPUs and write the final DSKY "
+    "and erasable state\n"
+    "                         of each job to its output file.\n"
+    "--jobs=N                 Number of worker threads used by "
+    "--batch (default =\n"
+    "                         number of online CPUs).\n"
+    "--select=PROGRAM         Run PROGRAM, a name or a number from 1, "
+    "when the\n"
+    "                         exec-ropes-file is a catalog made by "
+    "agc_catalog\n"
+    "                         (default = the first one).\n"
+    "--pace=MODE              How fast the simulation runs: realtime "
+    "(default), Nx\n"
+    "                         for N times real time, or max for as "
+    "fast as possible.\n"
     "Note that the exec-ropes file should contain exactly 36 banks\n"
     "(36x1024=36864 words, or 73728 bytes). Other sizes may be "
     "accepted,\n"
@@ -218,6 +235,11 @@ static void CliInitializeOptions(void)
   Options.cd                   = (char*)0;
   Options.cfg                  = (char*)0;
   Options.fromfile             = (char*)0;
+  Options.batch                = (char*)0;
+  Options.select               = (char*)0;
+  Options.jobs                 = 0;
+  Options.pace                 = SIM_PACE_REALTIME;
+  Options.speed                = 1;
   Options.port                 = 19697;
   Options.dump_time            = 10;
   Options.debug_dsky           = 0;
@@ -235,6 +257,30 @@ static void CliInitializeOptions(void)
   Options.no_resume            = 0;
 }
 
+/**
+This function parses the value of the --pace option into the pacing
+policy and speed-up factor of the simulator.
+\param *mode The text following "--pace="
+\return CLI_E_OK or CLI_E_UNKOWNTOKEN for an unknown policy. */
+static int CliParsePace(const char* mode)
+{
+  int speed;
+
+  if(!strcmp(mode, "realtime"))
+    Options.pace = SIM_PACE_REALTIME;
+  else if(!strcmp(mode, "max"))
+    Options.pace = SIM_PACE_UNTHROTTLED;
+  else if(1 == sscanf(mode, "%dx", &speed) && speed > 0)
+  {
+    Options.pace  = SIM_PACE_SCALED;
+    Options.speed = speed;
+  }
+  else
+    return (CLI_E_UNKOWNTOKEN);
+
+  return (CLI_E_OK);
+}
+
 /**
 This function takes a character string and checks the string for
 known command line options. To support both single and double dash
@@ -319,6 +365,14 @@ static int CliProcessArgument(char* token)
     Options.initializeSunburst37 = 1;
   else if(!strcmp(token, "-no-resume"))
     Options.no_resume = 1;
+  else if(!strncmp(token, "-batch=", 7))
+    Options.batch = strdup(&token[7]);
+  else if(!strncmp(token, "-select=", 8))
+    Options.select = strdup(&token[8]);
+  else if(1 == sscanf(token, "-jobs=%d", &j))
+    Options.jobs = j;
+  else if(!strncmp(token, "-pace=", 6))
+    result = CliParsePace(&token[6]);
   else if(Options.core == (char*)0)
     Options.core = strdup(token);
   else if(Options.resume == (char*)0)
@@ -353,7 +407,7 @@ opt_t* cli_parse_args(int argc, char* argv[])
 	 * display the usage message. Otherwise proceed with the automatic
 	 * values based on the core-ropes image name.
 	 */
-  if(argc == 1 || i < argc || (!Options.core && !Options.debug_dsky))
+  if(argc == 1 || i < argc || (!Options.core && !Options.debug_dsky && !Options.batch))
   {
     /* Check if only version info is requested */
     if(Options.version)
@@ -380,7 +434,7 @@ opt_t* cli_parse_args(int argc, char* argv[])
     /* Must have .bin extension to find the symbol table based on the
 		 * core basename with the bin extension.
 		 */
-    if(strstr(Options.core, ".bin"))
+    if(Options.core && strstr(Options.core, ".bin"))
     {
       int FullPathLength = strlen(Options.core);
 
@@ -0,0 +1,338 @@
+#include "batch.h"
+
+#include <cjson/cJSON.h>
+#include <core/agc_engine.h>
+#include <core/dsky.h>
+#include <core/dsky_dump.h>
+#include <core/profile.h>
+#include <core/snapshot.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file.h"
+
+#define BATCH_CYCLES_PER_SECOND (1024000 / 12)
+#define BATCH_SLICE_CYCLES 1024
+#define BATCH_KEY_CYCLES (BATCH_CYCLES_PER_SECOND / 4)
+
+// Flight profile of the jobs that do not name one.
+#define BATCH_PROFILE "resources/profile.bin"
+
+typedef struct
+{
+  const char* name;
+  const char* rom;
+  const char* core;
+  const char* profile;
+  const char* keys;
+  const char* output;
+  const char* snapshot;
+  uint64_t    key_start;
+  uint64_t    cycles;
+  int         result;
+} batch_job_t;
+
+typedef struct
+{
+  batch_job_t* jobs;
+  int          n_jobs;
+  atomic_int   next_job;
+} batch_pool_t;
+
+static const char* batch_string(cJSON* item, const char* name)
+{
+  cJSON* value = cJSON_GetObjectItemCaseSensitive(item, name);
+  return cJSON_IsString(value) ? value->valuestring : NULL;
+}
+
+static double batch_number(cJSON* item, const char* name, double fallback)
+{
+  cJSON* value = cJSON_GetObjectItemCaseSensitive(item, name);
+  return cJSON_IsNumber(value) ? value->valuedouble : fallback;
+}
+
+/**
+Presses the DSKY key for one character of a job's key script and returns
+the number of cycles to wait before the next one. The characters are the
+ones the interactive console understands plus C, + and -; '_' waits one
+second and whitespace is ignored. */
+static uint64_t batch_press(agc_state_t* state, char c)
+{
+  switch(c)
+  {
+    case '0':
+      dsky_press_key(state, KEY_ZERO);
+      break;
+    case 'V':
+    case 'v':
+      dsky_press_key(state, KEY_VERB);
+      break;
+    case 'N':
+    case 'n':
+      dsky_press_key(state, KEY_NOUN);
+      break;
+    case 'R':
+    case 'r':
+      dsky_press_key(state, KEY_RSET);
+      break;
+    case 'K':
+    case 'k':
+      dsky_press_key(state, KEY_KEY_REL);
+      break;
+    case 'C':
+    case 'c':
+      dsky_press_key(state, KEY_CLR);
+      break;
+    case '+':
+      dsky_press_key(state, KEY_PLUS);
+      break;
+    case '-':
+      dsky_press_key(state, KEY_MINUS);
+      break;
+    case 'P':
+    case 'p':
+      dsky_press_pro(state, 0);
+      break;
+    case 'O':
+    case 'o':
+      dsky_press_pro(state, 1);
+      break;
+    case 'E':
+    case 'e':
+      dsky_press_key(state, KEY_ENTER);
+      break;
+    case '_':
+      return BATCH_CYCLES_PER_SECOND;
+    default:
+      if('1' <= c && c <= '9')
+        dsky_press_key(state, c - '1' + KEY_ONE);
+      else
+        return 0;
+  }
+  return BATCH_KEY_CYCLES;
+}
+
+static uint8_t* batch_read(batch_job_t* job, const char* path, uint64_t* len)
+{
+  uint8_t* data = read_file(path, len);
+  if(!data)
+    fprintf(stderr, "%s: cannot read %s\n", job->name, path);
+  return data;
+}
+
+static int batch_write_state(batch_job_t* job, agc_state_t* state, dsky_t* dsky)
+{
+  FILE* out = fopen(job->output, "w");
+  if(!out)
+  {
+    perror(job->output);
+    return 1;
+  }
+
+  fprintf(out, "job %s\ncycles %llu\n", job->name, (unsigned long long)state->cycle_counter);
+  fprintf(out, "output drops %u high water %u\n", state->output_drops, state->output_high_water);
+  dsky_fprint(out, dsky);
+
+  for(int bank = 0; bank < 8; bank++)
+    for(int j = 0; j < 0400; j += 8)
+    {
+      fprintf(out, "E%o,%04o:", bank, j);
+      for(int k = 0; k < 8; k++)
+        fprintf(out, " %05o", state->erasable[bank][j + k]);
+      fprintf(out, "\n");
+    }
+
+  fclose(out);
+  return 0;
+}
+
+/**
+Runs one job unthrottled: the key script and the flight model are driven by
+the cycle counter only, so the same job always produces the same output. */
+static int batch_run_job(batch_job_t* job)
+{
+  agc_state_t* state   = calloc(1, sizeof(agc_state_t));
+  profile_t*   profile = calloc(1, sizeof(profile_t));
+  int          result  = 1;
+  uint64_t     len;
+  uint8_t*     data;
+
+  if(!state || !profile)
+    goto Done;
+
+  data = batch_read(job, job->rom, &len);
+  if(!data)
+    goto Done;
+  result = agc_load_rom(state, data, len);
+  free(data);
+  if(result)
+  {
+    fprintf(stderr, "%s: cannot load %s\n", job->name, job->rom);
+    goto Done;
+  }
+
+  result = 1;
+  agc_engine_init(state, NULL, 0, 0);
+
+  const char* profile_file = job->profile ? job->profile : BATCH_PROFILE;
+  if(!profile_open(profile, profile_file))
+  {
+    fprintf(stderr, "%s: cannot load %s\n", job->name, profile_file);
+    goto Done;
+  }
+
+  dsky_t   dsky;
+  flight_t flight;
+  dsky_init(&dsky);
+  flight_init(&flight, profile);
+
+  // A job can continue from the snapshot another one finished with.
+  if(job->core)
+  {
+    if(!(data = batch_read(job, job->core, &len)))
+      goto Done;
+    int error = snapshot_load(state, &dsky, &flight, data, len);
+    free(data);
+    if(error)
+    {
+      fprintf(stderr, "%s: %s is not a snapshot of %s\n", job->name, job->core, job->rom);
+      goto Done;
+    }
+  }
+
+  const char* key      = job->keys ? job->keys : "";
+  uint64_t    next_key = job->key_start;
+
+  while(state->cycle_counter < job->cycles)
+  {
+    // Stop at the next key press so that it lands on the same cycle however
+    // often the engine returns early.
+    uint64_t slice = job->cycles - state->cycle_counter;
+    if(slice > BATCH_SLICE_CYCLES)
+      slice = BATCH_SLICE_CYCLES;
+    if(*key && next_key > state->cycle_counter && next_key - state->cycle_counter < slice)
+      slice = next_key - state->cycle_counter;
+    agc_engine_run(state, slice);
+
+    while(*key && state->cycle_counter >= next_key)
+      next_key = state->cycle_counter + batch_press(state, *key++);
+
+    sim2agc_handle(state, &dsky, &flight);
+    agc2dsky_handle(state, &dsky, &flight);
+  }
+
+  result = batch_write_state(job, state, &dsky);
+  if(job->snapshot && !save_snapshot(job->snapshot, state, &dsky, &flight))
+    result = 1;
+
+Done:
+  if(profile)
+    profile_free(profile);
+  free(profile);
+  if(state)
+    agc_unload_rom(state);
+  free(state);
+  return result;
+}
+
+static void* batch_worker(void* arg)
+{
+  batch_pool_t* pool = arg;
+  int           i;
+
+  // Jobs are coarse grained, so a shared claim counter keeps every worker
+  // busy until the manifest is exhausted without per-thread queues.
+  while((i = atomic_fetch_add(&pool->next_job, 1)) < pool->n_jobs)
+    pool->jobs[i].result = batch_run_job(&pool->jobs[i]);
+
+  return NULL;
+}
+
+static int batch_parse(cJSON* json, batch_pool_t* pool)
+{
+  if(!cJSON_IsArray(json))
+    return 1;
+
+  pool->n_jobs = cJSON_GetArraySize(json);
+  pool->jobs   = calloc(pool->n_jobs ? pool->n_jobs : 1, sizeof(batch_job_t));
+  if(!pool->jobs)
+    return 1;
+
+  int    i    = 0;
+  cJSON* item = NULL;
+  cJSON_ArrayForEach(item, json)
+  {
+    batch_job_t* job = &pool->jobs[i++];
+
+    job->rom       = batch_string(item, "rom");
+    job->core      = batch_string(item, "core");
+    job->profile   = batch_string(item, "profile");
+    job->keys      = batch_string(item, "keys");
+    job->output    = batch_string(item, "output");
+    job->snapshot  = batch_string(item, "snapshot");
+    job->name      = batch_string(item, "name");
+    job->key_start = batch_number(item, "key_start", 0) * BATCH_CYCLES_PER_SECOND;
+    job->cycles    = batch_number(item, "cycles", 0);
+
+    if(!job->name)
+      job->name = job->output;
+    if(!job->rom || !job->output || !job->cycles)
+    {
+      fprintf(stderr, "job %d: rom, output and cycles are required\n", i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int batch_run(const char* manifest, int threads)
+{
+  uint64_t     len;
+  batch_pool_t pool = {0};
+  int          failed = 0;
+
+  char* text = (char*)read_file(manifest, &len);
+  if(!text)
+    return 1;
+
+  cJSON* json = cJSON_ParseWithLength(text, len);
+  free(text);
+  if(!json || batch_parse(json, &pool))
+  {
+    fprintf(stderr, "%s: invalid batch manifest\n", manifest);
+    cJSON_Delete(json);
+    free(pool.jobs);
+    return 1;
+  }
+
+  if(threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(threads > pool.n_jobs)
+    threads = pool.n_jobs;
+  atomic_init(&pool.next_job, 0);
+
+  pthread_t* workers = calloc(threads ? threads : 1, sizeof(pthread_t));
+  int        started = 0;
+  while(started < threads && !pthread_create(&workers[started], NULL, batch_worker, &pool))
+    started++;
+  // Runs the jobs on the calling thread if no worker could be started.
+  if(!started)
+    batch_worker(&pool);
+  for(int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+  free(workers);
+
+  for(int i = 0; i < pool.n_jobs; i++)
+  {
+    printf("%-8s %s\n", pool.jobs[i].result ? "FAILED" : "ok", pool.jobs[i].name);
+    failed += pool.jobs[i].result != 0;
+  }
+
+  cJSON_Delete(json);
+  free(pool.jobs);
+  return failed != 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+/**
+Runs every job listed in the JSON manifest on a pool of worker threads and
+writes the final DSKY and erasable state of each job to its output file.
+The manifest is an array of jobs:
+
+  [{"name": "p11", "rom": "bin/Colossus249.bin", "core": "p00.snap",
+    "profile": "resources/profile.json", "keys": "V37E11E", "key_start": 30,
+    "cycles": 8533333, "output": "p11.txt", "snapshot": "p11.snap"}]
+
+rom, cycles and output are required. keys is typed key_start seconds of AGC
+time after power-on, see batch_press() for the characters it accepts. A job
+with a core snapshot continues from it instead of from power-on, and cycles
+and key_start still count from power-on; snapshot is written when the job
+is done. Without a profile, a job flies resources/profile.bin.
+Returns 0 when all jobs succeeded. */
+int batch_run(const char* manifest, int threads);
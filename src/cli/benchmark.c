@@ -0,0 +1,47 @@
+#include <core/agc_engine.h>
+#include <core/benchmark.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "file.h"
+
+#define AGC_PER_SECOND_F (1024000.0 / 12)
+
+static agc_state_t state;
+
+/**
+Measures how fast the engine runs on the host. Usage:
+  agc_benchmark [rom-file] [cycles]
+Build both agc_benchmark and agc_benchmark_threaded to compare the switch
+statement instruction dispatch against the computed-goto one.
+*/
+int main(int argc, char* argv[])
+{
+  const char* rom_file = argc > 1 ? argv[1] : "bin/Colossus249.bin";
+  uint64_t    cycles   = argc > 2 ? strtoull(argv[2], NULL, 10) : 100000000;
+
+  uint64_t len;
+  uint8_t* rom = read_file(rom_file, &len);
+  if(!rom)
+    return 1;
+  agc_load_rom(&state, rom, len);
+  free(rom);
+  agc_engine_init(&state, NULL, 0, 0);
+
+  uint64_t elapsed_us = agc_benchmark(&state, cycles);
+  double   seconds    = elapsed_us / 1e6;
+
+  printf(
+    "%s: %llu MCT in %.3f s, %.2f MMCT/s, %.1fx real time\n",
+#ifdef AGC_THREADED_DISPATCH
+    "threaded dispatch",
+#else
+    "switch dispatch",
+#endif
+    (unsigned long long)cycles,
+    seconds,
+    cycles / seconds / 1e6,
+    cycles / seconds / AGC_PER_SECOND_F);
+
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include <core/catalog.h>
+#include <core/snapshot.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+
+typedef struct
+{
+  const char* rom;
+  const char* core;
+  const char* profile;
+  uint32_t    flags;
+} source_t;
+
+static uint32_t align(uint64_t offset)
+{
+  return (offset + CATALOG_ALIGN - 1) / CATALOG_ALIGN * CATALOG_ALIGN;
+}
+
+// Size of a file, 0 if it cannot be opened; read_file() reports that later.
+static uint64_t file_size(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if(!file)
+    return 0;
+  fseek(file, 0, SEEK_END);
+  long len = ftell(file);
+  fclose(file);
+  return len > 0 ? len : 0;
+}
+
+// Reads a file into the catalog at offset, checked by check. Returns its size,
+// 0 if it cannot be read, is not what check expects or does not fit in max.
+static uint32_t add_file(uint8_t* catalog, uint64_t offset, uint64_t max, const char* path,
+  const char* (*check)(const uint8_t* data, uint64_t len, const void* arg), const void* arg)
+{
+  uint64_t len;
+  uint8_t* data = read_file(path, &len);
+  if(!data)
+    return 0;
+
+  const char* error = check(data, len, arg);
+  if(!error && len > max)
+    error = "too large";
+  if(error)
+  {
+    fprintf(stderr, "%s: %s\n", path, error);
+    free(data);
+    return 0;
+  }
+  memcpy(catalog + offset, data, len);
+  free(data);
+  return len;
+}
+
+static const char* check_rom(const uint8_t* data, uint64_t len, const void* arg)
+{
+  (void)arg;
+  if(agc_verify_rom(data, len))
+    return "not a packed ROM image, pack it with agc_rom first";
+  if(!catalog_name_ok(((const agc_rom_header_t*)data)->name))
+    return "bad program name, set one with agc_rom --name";
+  return NULL;
+}
+
+static const char* check_core(const uint8_t* data, uint64_t len, const void* arg)
+{
+  const agc_rom_header_t* rom = arg;
+  switch(snapshot_check(data, len, rom->crc))
+  {
+    case SNAPSHOT_E_OK:
+      return NULL;
+    case SNAPSHOT_E_CHECKSUM:
+      return "truncated or corrupted snapshot";
+    case SNAPSHOT_E_ROM:
+      return "not a snapshot of this ROM";
+    default:
+      return "not a snapshot";
+  }
+}
+
+static const char* check_profile(const uint8_t* data, uint64_t len, const void* arg)
+{
+  (void)arg;
+  profile_t profile;
+  if(!profile_map(&profile, data, len))
+    return "not a binary profile, convert it with agc_profile first";
+  return NULL;
+}
+
+/**
+Builds a catalog of programs for agc_native and agc_pico, one entry per
+packed ROM image. --cm marks the next ROM as Command Module software,
+--core gives the snapshot its slot starts with and --profile its flight
+profile; they apply to the next ROM only. Usage:
+  agc_catalog <catalog.bin> [--cm] [--core=SNAPSHOT] [--profile=PROFILE] <rom.rom>...
+A profile named for several entries is stored once.
+*/
+int main(int argc, char* argv[])
+{
+  source_t    sources[CATALOG_ENTRIES];
+  source_t    next   = {0};
+  const char* output = NULL;
+  int         n_roms = 0;
+  bool        usage  = false;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "--cm"))
+      next.flags |= CATALOG_CM;
+    else if(!strncmp(argv[i], "--core=", 7))
+      next.core = argv[i] + 7;
+    else if(!strncmp(argv[i], "--profile=", 10))
+      next.profile = argv[i] + 10;
+    else if(!strncmp(argv[i], "--", 2))
+      usage = true;
+    else if(!output)
+      output = argv[i];
+    else if(n_roms < CATALOG_ENTRIES)
+    {
+      next.rom          = argv[i];
+      sources[n_roms++] = next;
+      next              = (source_t){0};
+    }
+    else
+      usage = true;
+  }
+  if(usage || !n_roms || next.flags || next.core || next.profile)
+  {
+    fprintf(stderr,
+      "usage: %s <catalog.bin> [--cm] [--core=SNAPSHOT] [--profile=PROFILE] <rom.rom>...\n"
+      "at most %d ROM images\n",
+      argv[0], CATALOG_ENTRIES);
+    return 2;
+  }
+
+  // Everything is laid out in a buffer as large as all the inputs together
+  // could need, erased like flash.
+  uint64_t capacity = align(sizeof(catalog_header_t));
+  for(int i = 0; i < n_roms; i++)
+    capacity += align(file_size(sources[i].rom)) + CATALOG_CORE_SLOT +
+                (sources[i].profile ? align(file_size(sources[i].profile)) : 0);
+
+  uint8_t* catalog = malloc(capacity);
+  if(!catalog)
+  {
+    perror("agc_catalog");
+    return 1;
+  }
+  memset(catalog, 0xff, capacity);
+
+  catalog_header_t header = {.magic = CATALOG_MAGIC, .version = CATALOG_VERSION, .count = n_roms};
+  memset(header.entries, 0, sizeof(header.entries));
+  uint64_t offset = align(sizeof(catalog_header_t));
+  int      result = 0;
+  for(int i = 0; i < n_roms && !result; i++)
+  {
+    catalog_entry_t* entry = &header.entries[i];
+    entry->flags           = sources[i].flags;
+
+    entry->rom = (catalog_span_t){offset, add_file(catalog, offset, capacity - offset, sources[i].rom, check_rom, NULL)};
+    if(!entry->rom.size)
+    {
+      result = 1;
+      break;
+    }
+    const agc_rom_header_t* rom = (const agc_rom_header_t*)(catalog + offset);
+    memcpy(entry->name, rom->name, sizeof(entry->name));
+    offset = align(offset + entry->rom.size);
+
+    entry->core = (catalog_span_t){offset, CATALOG_CORE_SLOT};
+    if(sources[i].core && !add_file(catalog, offset, CATALOG_CORE_SLOT, sources[i].core, check_core, rom))
+      result = 1;
+    offset += CATALOG_CORE_SLOT;
+
+    if(!sources[i].profile)
+      continue;
+    for(int j = 0; j < i; j++)
+      if(sources[j].profile && !strcmp(sources[j].profile, sources[i].profile))
+        entry->profile = header.entries[j].profile;
+    if(entry->profile.size)
+      continue;
+    entry->profile = (catalog_span_t){offset, add_file(catalog, offset, capacity - offset, sources[i].profile, check_profile, NULL)};
+    if(!entry->profile.size)
+      result = 1;
+    offset = align(offset + entry->profile.size);
+  }
+
+  if(!result)
+  {
+    header.size = offset;
+    header.crc  = snapshot_crc32(0, header.entries, sizeof(header.entries));
+    memcpy(catalog, &header, sizeof(header));
+
+    FILE* file = fopen(output, "wb");
+    if(!file || fwrite(catalog, offset, 1, file) != 1)
+      result = 1;
+    if(file && fclose(file))
+      result = 1;
+    if(result)
+      fprintf(stderr, "%s: write failed\n", output);
+  }
+
+  if(!result)
+  {
+    for(int i = 0; i < n_roms; i++)
+    {
+      const catalog_entry_t* entry = &header.entries[i];
+      printf("%d: %s (%s), ROM %u bytes%s%s\n", i + 1, entry->name, entry->flags & CATALOG_CM ? "CM" : "LM",
+        entry->rom.size, sources[i].core ? ", snapshot" : "", entry->profile.size ? ", profile" : "");
+    }
+    printf("%s: %u bytes\n", output, header.size);
+  }
+  free(catalog);
+  return result;
+}
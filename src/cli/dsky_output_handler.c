@@ -5,46 +5,50 @@
 #include <termios.h>
 #include <unistd.h>
 
-void dsky2agc_handle()
+int dsky2agc_handle(agc_state_t* state)
 {
   int c = getchar();
   switch(c)
   {
     case '0':
-      dsky_press_key(KEY_ZERO);
+      dsky_press_key(state, KEY_ZERO);
       break;
     case 'V':
     case 'v':
-      dsky_press_key(KEY_VERB);
+      dsky_press_key(state, KEY_VERB);
       break;
     case 'N':
     case 'n':
-      dsky_press_key(KEY_NOUN);
+      dsky_press_key(state, KEY_NOUN);
       break;
     case 'R':
     case 'r':
-      dsky_press_key(KEY_RSET);
+      dsky_press_key(state, KEY_RSET);
       break;
     case 'K':
     case 'k':
-      dsky_press_key(KEY_KEY_REL);
+      dsky_press_key(state, KEY_KEY_REL);
       break;
     case 'P':
     case 'p':
-      dsky_press_pro(0);
+      dsky_press_pro(state, 0);
       break;
     case 'O':
     case 'o':
-      dsky_press_pro(1);
+      dsky_press_pro(state, 1);
       break;
     case 'E':
     case '\n':
-      dsky_press_key(KEY_ENTER);
+      dsky_press_key(state, KEY_ENTER);
       break;
+    case 'Z':
+    case 'z':
+      return DSKY_REQUEST_REWIND;
     case EOF:
       break;
     default:
       if('1' <= c && c <= '9')
-        dsky_press_key(c - '1' + KEY_ONE);
+        dsky_press_key(state, c - '1' + KEY_ONE);
   }
+  return 0;
 }
@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "core/snapshot.h"
+
 static uint8_t *read_file(const char *filename, uint64_t* len) {
   FILE *file = fopen(filename, "rb");
   if (!file) {
@@ -14,7 +16,7 @@ static uint8_t *read_file(const char *filename, uint64_t* len) {
   long length = ftell(file);
   rewind(file);
 
-  char *data = (char *)malloc(length + 1);
+  uint8_t *data = (uint8_t *)malloc(length + 1);
   if (!data) {
     perror("Memory allocation failed");
     fclose(file);
@@ -27,3 +29,31 @@ static uint8_t *read_file(const char *filename, uint64_t* len) {
   fclose(file);
   return data;
 }
+
+static inline bool write_file_chunk(void *file, const void *data, uint32_t len) {
+  return fwrite(data, 1, len, file) == len;
+}
+
+// Writes the snapshot next to filename first, so that a crash while saving
+// never leaves a truncated one behind.
+static inline bool save_snapshot(const char *filename, const agc_state_t *state,
+                          const dsky_t *dsky, const flight_t *flight) {
+  char temp[1024];
+  snprintf(temp, sizeof(temp), "%s.tmp", filename);
+
+  FILE *file = fopen(temp, "wb");
+  if (!file) {
+    perror("Failed to save snapshot");
+    return false;
+  }
+
+  bool ok = snapshot_save(state, dsky, flight, write_file_chunk, file) != 0;
+  ok = fclose(file) == 0 && ok;
+  if (ok && rename(temp, filename) != 0) {
+    perror("Failed to save snapshot");
+    ok = false;
+  }
+  if (!ok)
+    remove(temp);
+  return ok;
+}
@@ -0,0 +1,254 @@
+#include <stdint.h>
+
+#include <core/imu.h>
+#include <core/profile.h>
+#include <core/us_time.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEG_TO_RAD (M_PI / 180)
+#define ANGLE_INCR (360.0 / 32768 * DEG_TO_RAD)
+#define STEP_MS 100
+
+// The double precision Euler angle model the fixed point kernel replaced,
+// kept as the reference it is checked against.
+typedef struct
+{
+  double  imu_angle[3];
+  double  pimu[3];
+  double  velocity[3];
+  int64_t pipa[3];
+} reference_t;
+
+static double adjust(double x, double a, double b)
+{
+  return x - (b - a) * floor((x - a) / (b - a));
+}
+
+static int16_t reference_gimbal(reference_t* ref, int axis, double delta)
+{
+  ref->imu_angle[axis] = adjust(ref->imu_angle[axis] + delta, 0, 2 * M_PI);
+
+  double   dx   = adjust(ref->imu_angle[axis] - ref->pimu[axis], -M_PI, M_PI);
+  double   sign = dx > 0 ? +1 : -1;
+  uint16_t n    = floor(fabs(dx) / ANGLE_INCR);
+  ref->pimu[axis] = adjust(ref->pimu[axis] + sign * ANGLE_INCR * n, 0, 2 * M_PI);
+  return sign * n;
+}
+
+static void reference_rotate(reference_t* ref, const double delta[3], int16_t cdu[3])
+{
+  double MPI    = sin(ref->imu_angle[2]);
+  double MQI    = cos(ref->imu_angle[2]) * cos(ref->imu_angle[0]);
+  double MQM    = sin(ref->imu_angle[0]);
+  double MRI    = -cos(ref->imu_angle[2]) * sin(ref->imu_angle[0]);
+  double MRM    = cos(ref->imu_angle[0]);
+  double nenner = MRM * MQI - MRI * MQM;
+
+  double do_b = adjust(
+    delta[0] - (delta[1] * MRM * MPI - delta[2] * MQM * MPI) / nenner, -M_PI, M_PI);
+  double di_b = adjust((delta[1] * MRM - delta[2] * MQM) / nenner, -M_PI, M_PI);
+  double dm_b = adjust((delta[2] * MQI - delta[1] * MRI) / nenner, -M_PI, M_PI);
+
+  cdu[0] = reference_gimbal(ref, 0, do_b);
+  cdu[1] = reference_gimbal(ref, 1, di_b);
+  cdu[2] = reference_gimbal(ref, 2, dm_b);
+}
+
+static void reference_accelerate(reference_t* ref, const double delta[3], int16_t pipa[3])
+{
+  double sinOG = sin(ref->imu_angle[0]);
+  double sinIG = sin(ref->imu_angle[1]);
+  double sinMG = sin(ref->imu_angle[2]);
+  double cosOG = cos(ref->imu_angle[0]);
+  double cosIG = cos(ref->imu_angle[1]);
+  double cosMG = cos(ref->imu_angle[2]);
+
+  double dv[] = {
+    cosMG * cosIG * delta[0] + (-cosOG * sinMG * cosIG + sinOG * sinIG) * delta[1]
+      + (sinOG * sinMG * cosIG + cosOG * sinIG) * delta[2],
+    sinMG * delta[0] + cosOG * cosMG * delta[1] - sinOG * cosMG * delta[2],
+    -cosMG * sinIG * delta[0] + (cosOG * sinMG * sinIG + sinOG * cosIG) * delta[1]
+      + (-sinOG * sinMG * sinIG + cosOG * cosIG) * delta[2]
+  };
+
+  for(int axis = 0; axis < 3; axis++)
+  {
+    ref->velocity[axis] += dv[axis];
+    int16_t counts = floor((ref->velocity[axis] - ref->pipa[axis] * IMU_PIPA_INCR) / IMU_PIPA_INCR);
+    ref->pipa[axis] += counts;
+    pipa[axis] = counts;
+  }
+}
+
+typedef struct
+{
+  double  accel[3];
+  double  rot[3];
+  int64_t velocity[3];
+  int64_t angle[3];
+} step_t;
+
+// Flight steps as sim2agc_handle() derives them from the profile.
+static step_t* load_steps(profile_t* profile, int* n_steps)
+{
+  uint64_t duration = (uint64_t)profile->header.rows * profile->header.step_ms;
+  int      n        = duration / STEP_MS;
+  step_t*  steps    = calloc(n, sizeof(step_t));
+  if(!steps)
+    return NULL;
+
+  for(int i = 0; i < n; i++)
+  {
+    row_t   data = profile_get_data(profile, (uint64_t)i * STEP_MS);
+    step_t* step = &steps[i];
+    step->accel[0] = 1.08 * data.accel_x;
+    step->rot[0]   = -data.rot_x / 10 * DEG_TO_RAD;
+    step->rot[1]   = -data.rot_y / 10 * DEG_TO_RAD;
+    for(int axis = 0; axis < 3; axis++)
+    {
+      step->velocity[axis] = imu_velocity_from_mps(step->accel[axis]);
+      step->angle[axis]    = imu_angle_from_rad(step->rot[axis]);
+    }
+  }
+  *n_steps = n;
+  return steps;
+}
+
+// Checks the gimbal angles at and beyond gimbal lock, where the model has to
+// pick between two sets of angles for the same attitude: a gimbal set there
+// directly must stay put under a null rotation, and yawing the body through
+// the lock must turn only the middle gimbal. Returns the number of failures.
+static int check_gimbal_lock(void)
+{
+  static const double middle[] = {90, -90, 108, -108};
+
+  int failures = 0;
+  for(int i = 0; i < 4; i++)
+  {
+    imu_t imu;
+    imu_init(&imu);
+    imu_modify_gimbal(&imu, 0, imu_angle_from_rad(17 * DEG_TO_RAD));
+    imu_modify_gimbal(&imu, 1, imu_angle_from_rad(-40 * DEG_TO_RAD));
+    imu_modify_gimbal(&imu, 2, imu_angle_from_rad(middle[i] * DEG_TO_RAD));
+
+    int64_t none[3] = {0};
+    int16_t cdu[3];
+    imu_rotate(&imu, none, cdu);
+    bool ok = !cdu[0] && !cdu[1] && !cdu[2];
+    printf("middle gimbal at %g: cdu %d %d %d, %s\n", middle[i], cdu[0], cdu[1], cdu[2], ok ? "ok" : "FAILED");
+    failures += !ok;
+  }
+
+  // 180 degrees of yaw in 0.1 degree steps, through +90 degrees of middle gimbal.
+  imu_t imu;
+  imu_init(&imu);
+  int64_t yaw[3]   = {0, 0, imu_angle_from_rad(0.1 * DEG_TO_RAD)};
+  int64_t total[3] = {0};
+  int16_t cdu[3];
+  for(int i = 0; i < 1800; i++)
+  {
+    imu_rotate(&imu, yaw, cdu);
+    for(int axis = 0; axis < 3; axis++)
+      total[axis] += cdu[axis];
+  }
+  bool ok = !total[0] && !total[1] && llabs(total[2] - 16384) <= 1;
+  printf("yaw through gimbal lock: cdu %lld %lld %lld, %s\n", (long long)total[0], (long long)total[1],
+    (long long)total[2], ok ? "ok" : "FAILED");
+  return failures + !ok;
+}
+
+/**
+Runs the flight profile through the double precision Euler angle reference
+and the fixed point quaternion IMU model, compares the CDU and PIPA pulses
+they send, checks the model at gimbal lock and times both. Usage:
+  agc_imu_benchmark [profile] [repeat]
+*/
+int main(int argc, char* argv[])
+{
+  const char* file   = argc > 1 ? argv[1] : "resources/profile.bin";
+  int         repeat = argc > 2 ? atoi(argv[2]) : 100;
+
+  profile_t profile;
+  if(!profile_open(&profile, file))
+  {
+    fprintf(stderr, "%s: cannot load profile\n", file);
+    return 1;
+  }
+  int     n_steps;
+  step_t* steps = load_steps(&profile, &n_steps);
+  profile_free(&profile);
+  if(!steps)
+    return 1;
+
+  reference_t ref = {0};
+  imu_t       imu;
+  imu_init(&imu);
+
+  // The quaternion model integrates each step as an exact rotation where the
+  // reference steps the gimbal angles to first order, so the counters are
+  // compared by how far their running totals drift apart.
+  int64_t ref_cdu_total[3] = {0}, ref_pipa_total[3] = {0};
+  int64_t cdu_total[3] = {0}, pipa_total[3] = {0};
+  int64_t cdu_drift = 0, pipa_drift = 0;
+  for(int i = 0; i < n_steps; i++)
+  {
+    int16_t ref_pipa[3], ref_cdu[3], pipa[3], cdu[3];
+    reference_accelerate(&ref, steps[i].accel, ref_pipa);
+    reference_rotate(&ref, steps[i].rot, ref_cdu);
+    imu_accelerate(&imu, steps[i].velocity, pipa);
+    imu_rotate(&imu, steps[i].angle, cdu);
+
+    for(int axis = 0; axis < 3; axis++)
+    {
+      ref_cdu_total[axis] += ref_cdu[axis];
+      ref_pipa_total[axis] += ref_pipa[axis];
+      cdu_total[axis] += cdu[axis];
+      pipa_total[axis] += pipa[axis];
+      if(llabs(cdu_total[axis] - ref_cdu_total[axis]) > cdu_drift)
+        cdu_drift = llabs(cdu_total[axis] - ref_cdu_total[axis]);
+      if(llabs(pipa_total[axis] - ref_pipa_total[axis]) > pipa_drift)
+        pipa_drift = llabs(pipa_total[axis] - ref_pipa_total[axis]);
+    }
+  }
+  printf("%d steps\n", n_steps);
+  for(int axis = 0; axis < 3; axis++)
+    printf("axis %d: cdu %lld/%lld pipa %lld/%lld\n", axis, (long long)ref_cdu_total[axis],
+      (long long)cdu_total[axis], (long long)ref_pipa_total[axis], (long long)pipa_total[axis]);
+  printf("largest drift: %lld cdu, %lld pipa pulses\n", (long long)cdu_drift, (long long)pipa_drift);
+  int failures = check_gimbal_lock();
+
+  int16_t  out[3];
+  uint64_t start = time_us_64();
+  for(int r = 0; r < repeat; r++)
+  {
+    ref = (reference_t){0};
+    for(int i = 0; i < n_steps; i++)
+    {
+      reference_accelerate(&ref, steps[i].accel, out);
+      reference_rotate(&ref, steps[i].rot, out);
+    }
+  }
+  uint64_t reference_us = time_us_64() - start;
+
+  start = time_us_64();
+  for(int r = 0; r < repeat; r++)
+  {
+    imu_init(&imu);
+    for(int i = 0; i < n_steps; i++)
+    {
+      imu_accelerate(&imu, steps[i].velocity, out);
+      imu_rotate(&imu, steps[i].angle, out);
+    }
+  }
+  uint64_t fixed_us = time_us_64() - start;
+
+  double total = (double)n_steps * repeat;
+  printf("double reference: %.1f ns/step\n", reference_us * 1e3 / total);
+  printf("quaternion:       %.1f ns/step\n", fixed_us * 1e3 / total);
+
+  free(steps);
+  return failures ? 1 : 0;
+}
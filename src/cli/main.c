@@ -46,13 +46,17 @@
 
 #include <core/agc_simulator.h>
 #include <sys/fcntl.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <unistd.h>
 
 #include "agc_cli.h"
+#include "batch.h"
+#include "core/catalog.h"
 #include "core/dsky.h"
 #include "core/dsky_dump.h"
 #include "core/profile.h"
+#include "core/snapshot.h"
 #include "file.h"
 #include "pico/build/_deps/pico_sdk-src/src/rp2_common/pico_platform_common/include/pico/platform/common.h"
 #include "timer.h"
@@ -81,6 +85,12 @@ typedef struct {
   unsigned int value : 15;
 }intagc_t;
 
+static opt_t* options;
+
+// The simulation is resumed from and saved to this snapshot; a program from
+// a catalog uses state/<name>.bin and starts from the catalog's snapshot if
+// that does not exist yet. state/ is created on the first run.
+static const char* resume_file = "state/Core.bin";
 
 
 /**
@@ -89,6 +99,18 @@ Simulator is initialized and subsequently executed.
 */
 int main(int argc, char* argv[])
 {
+  options = cli_parse_args(argc, argv);
+  if(!options)
+    return 1;
+  if(options->batch)
+    return batch_run(options->batch, options->jobs);
+
+  // --version alone, or --debug-dsky without a ROM, has nothing to run
+  uint64_t len;
+  sim_t sim;
+  if(init_sim(&sim, options) || !options->core)
+    return 0;
+
   set_conio_terminal_mode();
 
   struct termios term;
@@ -98,37 +120,77 @@ int main(int argc, char* argv[])
   int oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
   fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
 
-  dsky_t dsky = {0};
-  dsky_init(&dsky);
-
-  const char *filename = "resources/profile.json";
-  uint64_t len;
-  char *file_contents = read_file(filename, &len);
-  if (!file_contents) {
+  // The exec-ropes file is a yaYUL or packed ROM image, or a catalog made by
+  // agc_catalog. A catalog stays in memory and the selected program runs
+  // from it in place, with its own profile and snapshot.
+  static profile_t profile;
+  uint8_t *rom = read_file(options->core, &len);
+  const catalog_header_t *catalog = catalog_map(rom, len);
+  const catalog_entry_t *entry = NULL;
+  int error;
+  if(catalog)
+  {
+    int index = options->select ? catalog_find(catalog, options->select) : 0;
+    if(index < 0)
+    {
+      printf("%s: no program %s in the catalog\n", options->core, options->select);
+      return 1;
+    }
+    entry = &catalog->entries[index];
+    error = catalog_select(catalog, index, &sim.state, &profile);
+
+    static char catalog_resume_file[64];
+    snprintf(catalog_resume_file, sizeof(catalog_resume_file), "state/%s.bin", entry->name);
+    resume_file = catalog_resume_file;
+  }
+  else
+  {
+    error = rom ? agc_load_rom(&sim.state, rom, len) : 1;
+    free(rom);
+  }
+  if(error)
+  {
+    printf("%s: cannot load the ROM (error %d)\n", options->core, error);
     return 1;
   }
-  profile_load_file(file_contents, len);
-  free((void*)file_contents);
-
-  sim_t sim;
-
-  opt_t* opt = cli_parse_args(argc, argv);
-  init_sim(&sim, opt);
-
-  char *rom = read_file("bin/Colossus249.bin", &len);
-  agc_load_rom(&sim.state, rom, len);
-  free(rom);
 
-  char *core = read_file("state/Core.bin", &len);
-  agc_engine_init(&sim.state, core, len, 0);
+  if(!profile.header.rows && !profile_open(&profile, "resources/profile.json"))
+    printf("failed to load profile\n");
+  sim.flight.profile = &profile;
+
+  agc_engine_init(&sim.state, NULL, 0, 0);
+  if(options->resume)
+    resume_file = options->resume;
+  else
+    mkdir("state", 0777);
+  bool resume = !options->no_resume && access(resume_file, F_OK) == 0;
+  uint8_t *core = resume ? read_file(resume_file, &len) : NULL;
+  if(core && snapshot_load(&sim.state, &sim.dsky, &sim.flight, core, len))
+    printf("%s: not a snapshot of this ROM, starting from power-on\n", resume_file);
+  else if(!core && entry && !options->no_resume)
+    snapshot_load(&sim.state, &sim.dsky, &sim.flight, catalog_data(catalog, &entry->core), entry->core.size);
   free(core);
 
+  // The session can be rewound by SIM_REWIND_US at a time with 'z'.
+  static history_t history;
+  static uint8_t history_buffer[256 * 1024];
+  history_init(&history, history_buffer, sizeof(history_buffer));
+  sim.history = &history;
+
   sim_exec(&sim);
 
   return (0);
 }
 
+void sim_save(sim_t* sim)
+{
+  save_snapshot(resume_file, &sim->state, &sim->dsky, &sim->flight);
+}
+
 void dsky_refresh(dsky_t *dsky)
 {
+  // Batch jobs report their final display in their output files instead.
+  if(options && options->batch)
+    return;
   dsky_print(dsky);
 }
@@ -0,0 +1,56 @@
+#include <core/profile.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "file.h"
+
+/**
+Converts a flight profile into the binary image the Pico reads from flash.
+Usage:
+  agc_profile <profile.json> <profile.bin>
+The input may also be a binary image, which is validated and copied.
+*/
+int main(int argc, char* argv[])
+{
+  if(argc != 3)
+  {
+    fprintf(stderr, "usage: %s <profile.json> <profile.bin>\n", argv[0]);
+    return 2;
+  }
+
+  uint64_t len;
+  uint8_t* data = read_file(argv[1], &len);
+  if(!data)
+    return 1;
+
+  profile_t profile;
+  bool      loaded = profile_load_file(&profile, data, len);
+  free(data);
+  if(!loaded)
+  {
+    fprintf(stderr, "%s: not a flight profile\n", argv[1]);
+    return 1;
+  }
+
+  FILE* file = fopen(argv[2], "wb");
+  if(!file)
+  {
+    perror(argv[2]);
+    profile_free(&profile);
+    return 1;
+  }
+
+  uint64_t size    = profile_size(&profile);
+  uint32_t rows    = profile.header.rows;
+  bool     written = fwrite(&profile.header, sizeof(profile_header_t), 1, file) == 1;
+  written         &= fwrite(profile.samples, sizeof(profile_sample_t), rows, file) == rows;
+  written         &= fclose(file) == 0;
+  if(!written)
+    fprintf(stderr, "%s: write failed\n", argv[2]);
+  else
+    printf("%s: %u rows, %u ms step, %llu bytes\n", argv[2], profile.header.rows,
+      profile.header.step_ms, (unsigned long long)size);
+
+  profile_free(&profile);
+  return written ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#include <core/agc_engine.h>
+#include <core/snapshot.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+
+// Names the image after the file it came from, without directory and extension.
+static void rom_name(char* name, int size, const char* path)
+{
+  const char* base = strrchr(path, '/');
+  base             = base ? base + 1 : path;
+  int len          = strcspn(base, ".");
+  if(len > size - 1)
+    len = size - 1;
+  memset(name, 0, size);
+  memcpy(name, base, len);
+}
+
+/**
+Packs a yaYUL ROM image into the image agc_map_rom() uses in place, with the
+fixed banks in order, the parity bits split off and, unless --compact is
+given, the predecoded instruction table, so nothing has to be converted at
+start-up. Usage:
+  agc_rom [--name=NAME] [--compact] <rom.bin> <rom.rom>
+The input may also be a packed image, which is verified and written again.
+*/
+int main(int argc, char* argv[])
+{
+  const char* name    = NULL;
+  bool        decoded = true;
+  const char* files[2];
+  int         n_files = 0;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strncmp(argv[i], "--name=", 7))
+      name = argv[i] + 7;
+    else if(!strcmp(argv[i], "--compact"))
+      decoded = false;
+    else if(n_files < 2)
+      files[n_files++] = argv[i];
+    else
+      n_files = 3;
+  }
+  if(n_files != 2)
+  {
+    fprintf(stderr, "usage: %s [--name=NAME] [--compact] <rom.bin> <rom.rom>\n", argv[0]);
+    return 2;
+  }
+
+  uint64_t len;
+  uint8_t* data = read_file(files[0], &len);
+  if(!data)
+    return 1;
+
+  agc_state_t* state = calloc(1, sizeof(agc_state_t));
+  int          error = state ? agc_load_rom(state, data, len) : 4;
+  free(data);
+  if(error)
+  {
+    fprintf(stderr, "%s: not a ROM image (error %d)\n", files[0], error);
+    free(state);
+    return 1;
+  }
+
+  // The banks and parity bits are taken over from the copy agc_load_rom()
+  // made, and the table from the one it uses, whose rows follow each other
+  // as no banks are cached.
+  agc_rom_header_t header = *(const agc_rom_header_t*)state->rom_copy;
+  const uint8_t*   banks  = (const uint8_t*)state->rom_copy + sizeof(agc_rom_header_t);
+  header.flags &= ~AGC_ROM_DECODED;
+  uint64_t banks_size = agc_rom_size(&header) - sizeof(agc_rom_header_t);
+  const agc_decoded_t* table      = state->decoded[0];
+  uint64_t             table_size = AGC_ROM_BANKS * 02000 * sizeof(agc_decoded_t);
+
+  if(name)
+  {
+    memset(header.name, 0, sizeof(header.name));
+    strncpy(header.name, name, sizeof(header.name) - 1);
+  }
+  else if(!header.name[0])
+    rom_name(header.name, sizeof(header.name), files[0]);
+
+  header.image_crc = snapshot_crc32(0, banks, banks_size);
+  if(decoded)
+  {
+    header.flags |= AGC_ROM_DECODED;
+    header.image_crc = snapshot_crc32(header.image_crc, table, table_size);
+  }
+
+  FILE* file = fopen(files[1], "wb");
+  if(!file)
+  {
+    perror(files[1]);
+    agc_unload_rom(state);
+    free(state);
+    return 1;
+  }
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  written     &= fwrite(banks, banks_size, 1, file) == 1;
+  if(decoded)
+    written &= fwrite(table, table_size, 1, file) == 1;
+  written &= fclose(file) == 0;
+  if(!written)
+    fprintf(stderr, "%s: write failed\n", files[1]);
+  else
+    printf("%s: %s, %u banks%s%s, %llu bytes\n", files[1], header.name, header.banks,
+      header.flags & AGC_ROM_PARITY ? ", parity" : "", decoded ? ", predecoded" : "",
+      (unsigned long long)agc_rom_size(&header));
+
+  agc_unload_rom(state);
+  free(state);
+  return written ? 0 : 1;
+}
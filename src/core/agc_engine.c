@@ -441,8 +441,10 @@
 #include <core/agc_engine.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include "agc.h"
+#include "ringbuffer.h"
 
 // If COARSE_SMOOTH is 1, then the timing of coarse-alignment (in terms of
 // bursting and separation of bursts) is according to the Delco manual.
@@ -473,6 +475,19 @@
 #define MASK10 001777
 #define MASK12 007777
 
+// When built with AGC_THREADED_DISPATCH (GCC only), the instruction decoder in
+// agc_engine() dispatches through a table of label addresses ("computed goto")
+// instead of the switch statement.  It is off by default: GCC will not inline a
+// function containing computed gotos, so the per-cycle call from
+// agc_engine_run() comes back and costs more than the saved range check.  Use
+// the agc_benchmark targets to compare both on a given core.
+#if defined(__GNUC__) && defined(AGC_THREADED_DISPATCH)
+#define OPCODE(label) label:
+#else
+#undef AGC_THREADED_DISPATCH
+#define OPCODE(label)
+#endif
+
 // Some numerical constant, in AGC format.
 #define AGC_P0 ((int16_t)0)
 #define AGC_M0 ((int16_t)077777)
@@ -524,6 +539,19 @@ int InhibitAlarms = 0;
 int ShowAlarms    = 0;
 int CmOrLm = 0;
 
+//-----------------------------------------------------------------------------
+// Events that fire at a known cycle count (DOWNRUPT, the channel routine) are
+// not polled every machine cycle.  Instead, state->next_event holds the earliest
+// cycle count at which any of them is due, and handle_events() is only called
+// once that time has been reached.  Anything that sets up a new event time
+// must pass it through schedule_event().
+
+static void schedule_event(agc_state_t* state, uint64_t time)
+{
+  if(time < state->next_event)
+    state->next_event = time;
+}
+
 //-----------------------------------------------------------------------------
 // Functions for reading or writing from/to i/o channels.  The reason we have
 // to provide a function for this rather than accessing the i/o-channel buffer
@@ -545,6 +573,8 @@ void write_io(agc_state_t* state, int addr, int val)
   val &= 077777;
   if(addr < 0 || addr > 0777)
     return;
+  // Several channels feed the hardware-driven DSKY lights.
+  state->dsky_dirty = 1;
   if(addr == RegL || addr == RegQ)
     mem0(addr) = val;
 
@@ -642,9 +672,46 @@ void cpu_write_io(agc_state_t* state, int addr, int val)
     state->downrupt_time_valid = 1;
     state->downrupt_time = state->cycle_counter + (AGC_PER_SECOND / 50);
     state->downlink      = 0;
+    schedule_event(state, state->downrupt_time);
   }
 }
 
+//-----------------------------------------------------------------------------
+// Helpers for fixed memory.  The first selects the fixed bank addressed by
+// a 12-bit address of 02000 or above, taking FB and the superbank bit into
+// account.  The second checks the stored parity of a fixed-memory word.
+
+static int fixed_bank(agc_state_t* state, int addr_12)
+{
+  int adj_fb;
+  if(addr_12 < 04000) // Fixed-switchable.
+  {
+    adj_fb = (037 & (mem0(RegFB) >> 10));
+    // Account for the superbank bit.
+    if(030 == (adj_fb & 030) && (state->output_channel_7 & 0100) != 0)
+      adj_fb += 010;
+  }
+  else if(addr_12 < 06000) // Fixed-fixed.
+    adj_fb = 2;
+  else // Fixed-fixed (continued).
+    adj_fb = 3;
+  return adj_fb;
+}
+
+static int fixed_parity_ok(agc_state_t* state, int bank, int offset)
+{
+  uint16_t linear_addr = bank * 02000 + offset;
+  int16_t  expected_parity = (uint32_t)bank < state->rom_banks
+    ? (state->parities[linear_addr / 32] >> (linear_addr % 32)) & 1 : 0;
+  int16_t word = (state->fixed[bank][offset] << 1) | expected_parity;
+  word ^= (word >> 8);
+  word ^= (word >> 4);
+  word ^= (word >> 2);
+  word ^= (word >> 1);
+  word &= 1;
+  return word == 1;
+}
+
 //-----------------------------------------------------------------------------
 // This function does all of the processing associated with converting a
 // 12-bit "address" as used within instructions or in the Z register, to a
@@ -666,6 +733,7 @@ static int16_t* find_memory_word(agc_state_t* state, int addr_12)
   {
     // Address 67 has been accessed in some way. Clear the Night Watchman.
     state->night_watchman = 0;
+    state->idle.seen |= IDLE_SEEN_NEWJOB;
   }
 
   // It should be noted as far as unswitched-erasable and common-fixed memory
@@ -685,42 +753,40 @@ static int16_t* find_memory_word(agc_state_t* state, int addr_12)
     return (&state->erasable[adj_eb][addr_12 & 00377]);
   }
 
-  int adj_fb;
-  if(addr_12 < 04000) // Fixed-switchable.
+  int      adj_fb = fixed_bank(state, addr_12);
+  // Fixed memory is read only, which assign_from_pointer() takes care of.
+  int16_t* addr   = (int16_t*)(&state->fixed[adj_fb][addr_12 & 01777]);
+
+  if(state->check_parity && !fixed_parity_ok(state, adj_fb, addr_12 & 01777))
   {
-    adj_fb = (037 & (mem0(RegFB) >> 10));
-    // Account for the superbank bit.
-    if(030 == (adj_fb & 030) && (state->output_channel_7 & 0100) != 0)
-      adj_fb += 010;
+    // The program is trying to access unused fixed memory, which
+    // will trigger a parity alarm.
+    state->parity_fail = 1;
+    input(077) |= CH77_PARITY_FAIL;
   }
-  else if(addr_12 < 06000) // Fixed-fixed.
-    adj_fb = 2;
-  else // Fixed-fixed (continued).
-    adj_fb = 3;
+  return addr;
+}
 
-  int16_t* addr = (&state->fixed[adj_fb][addr_12 & 01777]);
-
-  if(state->check_parity)
-  {
-    // Check parity for fixed memory if such checking is enabled
-    uint16_t linear_addr = adj_fb * 02000 + (addr_12 & 01777);
-    int16_t  expected_parity =
-      (state->parities[linear_addr / 32] >> (linear_addr % 32)) & 1;
-    int16_t word = ((*addr) << 1) | expected_parity;
-    word ^= (word >> 8);
-    word ^= (word >> 4);
-    word ^= (word >> 2);
-    word ^= (word >> 1);
-    word &= 1;
-    if(word != 1)
+//-----------------------------------------------------------------------------
+// Build the predecoded copy of fixed memory, for all AGC_ROM_BANKS banks.
+// This has to be done whenever the contents of State->fixed change, which in
+// practice means once, right after the ROM has been mapped, or even before
+// that by the agc_rom tool.
+
+void agc_engine_predecode(agc_state_t* state, agc_decoded_t (*table)[02000])
+{
+  for(int bank = 0; bank < AGC_ROM_BANKS; bank++)
+    for(int offset = 0; offset < 02000; offset++)
     {
-      // The program is trying to access unused fixed memory, which
-      // will trigger a parity alarm.
-      state->parity_fail = 1;
-      input(077) |= CH77_PARITY_FAIL;
+      agc_decoded_t* decoded = &table[bank][offset];
+      uint16_t       inst    = state->fixed[bank][offset] & 077777;
+      decoded->inst          = inst;
+      decoded->ext_ppcode    = inst >> 9;
+      decoded->timing =
+        InstructionTiming[inst >> 10] | (ExtracodeTiming[inst >> 10] << 4);
+      if(!fixed_parity_ok(state, bank, offset))
+        decoded->ext_ppcode |= DECODED_PARITY_FAIL;
     }
-  }
-  return addr;
 }
 
 //-----------------------------------------------------------------------------
@@ -783,6 +849,7 @@ static void assign(agc_state_t* state, int bank, int offset, int value)
   }
   else
     state->erasable[bank][offset] = value & 077777;
+  erasable_written(state, bank, offset);
 }
 
 static void assign_from_pointer(agc_state_t* state, int16_t* pointer, int value)
@@ -796,6 +863,17 @@ static void assign_from_pointer(agc_state_t* state, int16_t* pointer, int value)
   }
 }
 
+// Returns the pages of erasable memory written since the last call, one bit
+// per AGC_PAGE_WORDS words from bank 0 on, and starts over.  Page 0 is always
+// included.  A machine has a single reader of the bitmap, which passes the
+// bits on if several consumers need them.
+uint64_t agc_take_dirty_pages(agc_state_t* state)
+{
+  uint64_t pages        = state->erasable_dirty | 1;
+  state->erasable_dirty = 0;
+  return pages;
+}
+
 //-----------------------------------------------------------------------------
 // Compute the "diminished absolute value".  The input data and output data
 // are both in AGC 1's-complement format.
@@ -1066,9 +1144,6 @@ static int16_t neg_sp(int16_t value)
 // in Savage & Drake (E-2052) 1.4.8.  The functions all return 0 normally,
 // and return 1 on overflow.
 
-#include <stdio.h>
-static int trap_pipa = 0;
-
 // 1's-complement increment
 int counter_pinc(int16_t* counter)
 {
@@ -1083,15 +1158,9 @@ int counter_pinc(int16_t* counter)
   else
   {
     Overflow = 0;
-    if(trap_pipa)
-      printf("PINC: %o", i);
     i = ((i + 1) & 077777);
-    if(trap_pipa)
-      printf(" %o", i);
     if(i == AGC_P0) // Account for -0 to +1 transition.
       i++;
-    if(trap_pipa)
-      printf(" %o\n", i);
   }
   *counter = i;
   return (Overflow);
@@ -1111,15 +1180,9 @@ int counter_minc(int16_t* counter)
   else
   {
     ovf = 0;
-    if(trap_pipa)
-      printf("MINC: %o", i);
     i = ((i - 1) & 077777);
-    if(trap_pipa)
-      printf(" %o", i);
     if(i == AGC_M0) // Account for +0 to -1 transition.
       i--;
-    if(trap_pipa)
-      printf(" %o\n", i);
   }
   *counter = i;
   return (ovf);
@@ -1250,27 +1313,17 @@ static void interrupt_requests(agc_state_t* state, int16_t address_10, int sum)
 // Actually, there are two different fixed rates for PCDU/MCDU:  400 counts
 // per second in "slow mode", and 6400 counts per second in "fast mode".
 //
-// *** FIXME! All of the following junk will need to move to agc_t, and will
-//     somehow have to be made compatible with backtraces. ***
-// The way the FIFO works is that it can hold an ordered set of + counts and
-// - counts.  For example, if it held 7,-5,10, it would mean to apply 7 PCDUs,
-// followed by 5 MCDUs, followed by 10 PCDUs.  If there are too many sign-changes
-// buffered, triggers will be transparently dropped.
-#define MAX_CDU_FIFO_ENTRIES 128
-#define NUM_CDU_FIFOS 3 // Increase to 5 to include OPTX, OPTY.
+// The FIFOs themselves (cdu_fifo_t) live in agc_state_t.
 #define FIRST_CDU 032
 
-typedef struct
+// Recompute cdu_due after any of the FIFOs has changed.
+static void update_cdu_due(agc_state_t* state)
 {
-  int      idx;           // Index of next entry being pulled.
-  int      size;          // Number of entries.
-  int      interval_type; // 0,1,2,0,1,2,...
-  uint64_t next_update; // Cycle count at which next counter update occurs.
-  uint32_t counts[MAX_CDU_FIFO_ENTRIES];
-} cdu_fifo_t;
-
-static cdu_fifo_t CduFifos[NUM_CDU_FIFOS]; // For registers 032, 033, and 034.
-static int CduChecker = 0; // 0, 1, ..., NUM_CDU_FIFOS-1, 0, 1, ...
+  state->cdu_due = UINT64_MAX;
+  for(int i = 0; i < NUM_CDU_FIFOS; i++)
+    if(state->cdu_fifos[i].size > 0 && state->cdu_fifos[i].next_update < state->cdu_due)
+      state->cdu_due = state->cdu_fifos[i].next_update;
+}
 
 // Here's an auxiliary function to add a count to a CDU FIFO.  The only allowed
 // increment types are:
@@ -1310,7 +1363,7 @@ static void push_cdu_fifo(agc_state_t* state, int counter, int inc_type)
     default:
       return;
   }
-  cdu_fifo_t* cdu_fifo = &CduFifos[counter - FIRST_CDU];
+  cdu_fifo_t* cdu_fifo = &state->cdu_fifos[counter - FIRST_CDU];
   // It's a little easier if the FIFO is completely empty.
   if(cdu_fifo->size == 0)
   {
@@ -1319,6 +1372,7 @@ static void push_cdu_fifo(agc_state_t* state, int counter, int inc_type)
     cdu_fifo->counts[0]     = base + 1;
     cdu_fifo->next_update   = state->cycle_counter + interval;
     cdu_fifo->interval_type = 1;
+    update_cdu_due(state);
     return;
   }
   // Not empty, so find the last entry in the FIFO.
@@ -1358,13 +1412,13 @@ static int sdu_fifo(agc_state_t* state)
 {
   int         ret = 0;
   // See if there are any pending PCDU or MCDU counts we need to apply.  We only
-  // check one of the CDUs, and the CDU to check is indicated by CduChecker.
-  cdu_fifo_t* cdu_fifo = &CduFifos[CduChecker];
+  // check one of the CDUs, and the CDU to check is indicated by state->cdu_checker.
+  cdu_fifo_t* cdu_fifo = &state->cdu_fifos[state->cdu_checker];
 
   if(cdu_fifo->size > 0 && state->cycle_counter >= cdu_fifo->next_update)
   {
     // Update the counter.
-    int16_t* ch = &mem0(CduChecker + FIRST_CDU);
+    int16_t* ch = &mem0(state->cdu_checker + FIRST_CDU);
     int count       = cdu_fifo->counts[cdu_fifo->idx];
     int high_rate   = (count & 0x80000000);
     int down_count  = (count & 0x40000000);
@@ -1406,11 +1460,12 @@ static int sdu_fifo(agc_state_t* state)
         cdu_fifo->next_update += 214;
       cdu_fifo->interval_type = 0;
     }
+    update_cdu_due(state);
     // Return an indication that a counter was updated.
     ret = 1;
   }
 
-  CduChecker = (CduChecker + 1) % NUM_CDU_FIFOS;
+  state->cdu_checker = (state->cdu_checker + 1) % NUM_CDU_FIFOS;
   return (ret);
 }
 
@@ -1423,6 +1478,7 @@ void unprogrammed_increment(agc_state_t* state, int counter, int inc_type)
   int ovf = 0;
   counter &= 0x7f;
   int16_t* ch = &mem0(counter);
+  mem0_written(counter);
   switch(inc_type)
   {
     case 0:
@@ -1466,7 +1522,6 @@ void unprogrammed_increment(agc_state_t* state, int counter, int inc_type)
     // On some counters, overflow is supposed to cause
     // an interrupt.  Take care of setting the interrupt request here.
   }
-  trap_pipa = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -1475,14 +1530,13 @@ void unprogrammed_increment(agc_state_t* state, int counter, int inc_type)
 
 static int burst_output(agc_state_t* state, int drive_bit_mask, int counter_register, int channel)
 {
-  static int count_cdu_x = 0, count_cdu_y = 0, count_cdu_z = 0; // In target CPU format.
-  int        drive_count = 0, drive_count_saved;
+  int drive_count = 0, drive_count_saved;
   if(counter_register == RegCDUXCMD)
-    drive_count_saved = count_cdu_x;
+    drive_count_saved = state->count_cdu_x;
   else if(counter_register == RegCDUYCMD)
-    drive_count_saved = count_cdu_y;
+    drive_count_saved = state->count_cdu_y;
   else if(counter_register == RegCDUZCMD)
-    drive_count_saved = count_cdu_z;
+    drive_count_saved = state->count_cdu_z;
   else
     return (0);
   // Driving this axis?
@@ -1492,6 +1546,7 @@ static int burst_output(agc_state_t* state, int drive_bit_mask, int counter_regi
   {
     drive_count            = mem0(counter_register);
     mem0(counter_register) = 0;
+    mem0_written(counter_register);
   }
   // The count may be negative.  If so, normalize to be positive and set the
   // direction flag.
@@ -1523,17 +1578,18 @@ static int burst_output(agc_state_t* state, int drive_bit_mask, int counter_regi
   if(dir)
     drive_count_saved = -drive_count_saved;
   if(counter_register == RegCDUXCMD)
-    count_cdu_x = drive_count_saved;
+    state->count_cdu_x = drive_count_saved;
   else if(counter_register == RegCDUYCMD)
-    count_cdu_y = drive_count_saved;
+    state->count_cdu_y = drive_count_saved;
   else if(counter_register == RegCDUZCMD)
-    count_cdu_z = drive_count_saved;
+    state->count_cdu_z = drive_count_saved;
   return (drive_count_saved);
 }
 
 static void update_dsky(agc_state_t* state)
 {
   unsigned last_channel_163 = state->dsky_channel_163;
+  state->dsky_dirty         = 0;
 
   state->dsky_channel_163 &=
     ~(DSKY_KEY_REL | DSKY_VN_FLASH | DSKY_OPER_ERR | DSKY_RESTART
@@ -1701,8 +1757,6 @@ static void simulate_dv(agc_state_t* state, uint16_t divisor)
 // fast as the regular 1600 pps counters.
 #define GYRO_OVERFLOW 160
 #define GYRO_DIVIDER (2 * 3)
-static unsigned gyro_count     = 0;
-static unsigned old_channel_14 = 0, gyro_timer = 0;
 
 // Coarse-alignment.
 // The IMU CDU drive emits bursts every 600 ms.  Each cycle is
@@ -1711,8 +1765,6 @@ static unsigned old_channel_14 = 0, gyro_timer = 0;
 // to make it look pretty
 #define IMUCDU_BURST_CYCLES \
   ((600 * 1024000) / (1000 * 12 * COARSE_SMOOTH))
-static uint64_t imu_cdu_count  = 0;
-static unsigned imu_channel_14 = 0;
 
 int handle_counter_timers(agc_state_t* state)
 {
@@ -1756,6 +1808,7 @@ int handle_counter_timers(agc_state_t* state)
           // Standby is enabled, and PRO has been held down for the required amount of time.
           state->standby           = 1;
           state->sby_still_pressed = 1;
+          state->dsky_dirty        = 1;
 
           // While this isn't technically an alarm, it causes GOJAM just like all the rest
           if(ShowAlarms)
@@ -1769,7 +1822,8 @@ int handle_counter_timers(agc_state_t* state)
         else if(!state->sby_still_pressed)
         {
           // PRO was pressed for long enough to turn us back on. Let's get going!
-          state->standby = 0;
+          state->standby    = 0;
+          state->dsky_dirty = 1;
 
           // Turn off the STBY light
           state->dsky_channel_163 &= ~(DSKY_STBY | DSKY_EL_OFF);
@@ -1808,6 +1862,7 @@ int handle_counter_timers(agc_state_t* state)
       // generated (or if the light test is active), the filter is charged. Otherwise,
       // it slowly discharges. This is being modeled as a simple linear function right now,
       // and should be updated when we learn its real implementation details.
+      state->dsky_dirty = 1;
       if((0400 == (0777 & input(ChanSCALER1))) && (state->generated_warning || (input(013) & 01000)))
       {
         state->generated_warning = 0;
@@ -2013,6 +2068,7 @@ int handle_counter_timers(agc_state_t* state)
         {
           state->restart_light     = 1;
           state->generated_warning = 1;
+          state->dsky_dirty        = 1;
         }
       }
 
@@ -2041,16 +2097,17 @@ void handle_gyro(agc_state_t* state)
 
 #ifdef GYRO_TIMING_SIMULATED
   // Update the 3200 pps gyro pulse counter.
-  gyro_timer += GYRO_DIVIDER;
-  while(gyro_timer >= GYRO_OVERFLOW)
+  state->gyro_timer += GYRO_DIVIDER;
+  while(state->gyro_timer >= GYRO_OVERFLOW)
   {
-    gyro_timer -= GYRO_OVERFLOW;
+    state->gyro_timer -= GYRO_OVERFLOW;
     // We get to this point 3200 times per second.  We increment the
     // pulse count only if the GYRO ACTIVITY bit in channel 014 is set.
     if(0 != (input(014) & 01000) && mem0(RegGYROCTR) > 0)
     {
-      gyro_count++;
+      state->gyro_count++;
       mem0(RegGYROCTR)--;
+      mem0_written(RegGYROCTR);
       if(mem0(RegGYROCTR) == 0)
         input(014) &= ~01000;
     }
@@ -2059,11 +2116,11 @@ void handle_gyro(agc_state_t* state)
   // If 1/4 second (nominal gyro pulse count of 800 decimal) or the gyro
   // bits in channel 014 have changed, output to channel 0177.
   uint16_t i = input(014) & 01740; // Pick off the gyro bits.
-  if(i != old_channel_14 || gyro_count >= 800)
+  if(i != state->old_channel_14 || state->gyro_count >= 800)
   {
-    int j          = ((old_channel_14 & 0740) << 6) | gyro_count;
-    old_channel_14 = i;
-    gyro_count     = 0;
+    int j          = ((state->old_channel_14 & 0740) << 6) | state->gyro_count;
+    state->old_channel_14 = i;
+    state->gyro_count     = 0;
     agc_channel_output(state, 0177, j);
   }
 #else // GYRO_TIMING_SIMULATED
@@ -2074,32 +2131,33 @@ void handle_gyro(agc_state_t* state)
     {
       // If any torquing is still pending, do it all at once before
       // setting up a new torque counter.
-      while(gyro_count)
+      while(state->gyro_count)
       {
-        int j = gyro_count;
+        int j = state->gyro_count;
         if(j > 03777)
           j = 03777;
-        agc_channel_output(state, 0177, old_channel_14 | j);
-        gyro_count -= j;
+        agc_channel_output(state, 0177, state->old_channel_14 | j);
+        state->gyro_count -= j;
       }
       // Set up new torque counter.
-      gyro_count                     = state->erasable[0][RegGYROCTR];
+      state->gyro_count                     = state->erasable[0][RegGYROCTR];
       state->erasable[0][RegGYROCTR] = 0;
-      old_channel_14                 = ((input(014) & 0740) << 6);
-      gyro_timer = GYRO_OVERFLOW * GYRO_BURST - GYRO_DIVIDER;
+      mem0_written(RegGYROCTR);
+      state->old_channel_14                 = ((input(014) & 0740) << 6);
+      state->gyro_timer = GYRO_OVERFLOW * GYRO_BURST - GYRO_DIVIDER;
     }
   // Update the 3200 pps gyro pulse counter.
-  gyro_timer += GYRO_DIVIDER;
-  while(gyro_timer >= GYRO_BURST * GYRO_OVERFLOW)
+  state->gyro_timer += GYRO_DIVIDER;
+  while(state->gyro_timer >= GYRO_BURST * GYRO_OVERFLOW)
   {
-    gyro_timer -= GYRO_BURST * GYRO_OVERFLOW;
-    if(gyro_count)
+    state->gyro_timer -= GYRO_BURST * GYRO_OVERFLOW;
+    if(state->gyro_count)
     {
-      int j = gyro_count;
+      int j = state->gyro_count;
       if(j > GYRO_BURST2)
         j = GYRO_BURST2;
-      agc_channel_output(state, 0177, old_channel_14 | j);
-      gyro_count -= j;
+      agc_channel_output(state, 0177, state->old_channel_14 | j);
+      state->gyro_count -= j;
     }
   }
 #endif // GYRO_TIMING_SIMULATED
@@ -2113,31 +2171,31 @@ void handle_imu(agc_state_t* state)
 
 #if 1
   uint16_t i = (input(014) & 070000); // Check IMU CDU drive bits.
-  if(imu_channel_14 == 0 && i != 0) // If suddenly active, start drive.
-    imu_cdu_count = IMUCDU_BURST_CYCLES;
-  if(i != 0 && imu_cdu_count >= IMUCDU_BURST_CYCLES) // Time for next burst.
+  if(state->imu_channel_14 == 0 && i != 0) // If suddenly active, start drive.
+    state->imu_cdu_count = IMUCDU_BURST_CYCLES;
+  if(i != 0 && state->imu_cdu_count >= IMUCDU_BURST_CYCLES) // Time for next burst.
   {
     // Adjust the cycle counter.
-    imu_cdu_count -= IMUCDU_BURST_CYCLES;
+    state->imu_cdu_count -= IMUCDU_BURST_CYCLES;
     // Determine how many pulses are wanted on each axis this burst.
-    imu_channel_14 = burst_output(state, 040000, RegCDUXCMD, 0174);
-    imu_channel_14 |= burst_output(state, 020000, RegCDUYCMD, 0175);
-    imu_channel_14 |= burst_output(state, 010000, RegCDUZCMD, 0176);
+    state->imu_channel_14 = burst_output(state, 040000, RegCDUXCMD, 0174);
+    state->imu_channel_14 |= burst_output(state, 020000, RegCDUYCMD, 0175);
+    state->imu_channel_14 |= burst_output(state, 010000, RegCDUZCMD, 0176);
   }
   else
-    imu_cdu_count++;
+    state->imu_cdu_count++;
 #else  // 0
   uint16_t i = (input(014) & 070000); // Check IMU CDU drive bits.
-  if(imu_channel_14 == 0 && i != 0) // If suddenly active, start drive.
-    imu_cdu_count = state->cycle_counter - IMUCDU_BURST_CYCLES;
-  if(i != 0 && (state->cycle_counter - imu_cdu_count) >= IMUCDU_BURST_CYCLES) // Time for next burst.
+  if(state->imu_channel_14 == 0 && i != 0) // If suddenly active, start drive.
+    state->imu_cdu_count = state->cycle_counter - IMUCDU_BURST_CYCLES;
+  if(i != 0 && (state->cycle_counter - state->imu_cdu_count) >= IMUCDU_BURST_CYCLES) // Time for next burst.
   {
     // Adjust the cycle counter.
-    imu_cdu_count += IMUCDU_BURST_CYCLES;
+    state->imu_cdu_count += IMUCDU_BURST_CYCLES;
     // Determine how many pulses are wanted on each axis this burst.
-    imu_channel_14 = burst_output(state, 040000, RegCDUXCMD, 0174);
-    imu_channel_14 |= burst_output(state, 020000, RegCDUYCMD, 0175);
-    imu_channel_14 |= burst_output(state, 010000, RegCDUZCMD, 0176);
+    state->imu_channel_14 = burst_output(state, 040000, RegCDUXCMD, 0174);
+    state->imu_channel_14 |= burst_output(state, 020000, RegCDUYCMD, 0175);
+    state->imu_channel_14 |= burst_output(state, 010000, RegCDUZCMD, 0176);
   }
 #endif // 0
 }
@@ -2162,11 +2220,19 @@ void handle_optics(agc_state_t* state)
   }
 }
 
-int agc_engine(agc_state_t* state)
+//----------------------------------------------------------------------------
+// Fire whichever scheduled events have come due, and work out when the next
+// one is.  Called at the start of a machine cycle, before cycle_counter is
+// incremented.
+
+static void handle_events(agc_state_t* state)
 {
-  //int Operand;
-  //int OverflowQ, Qumulator;
-  // Keep track of TC executions for the TC Trap alarm
+  // The first time through the loop, light up the DSKY RESTART light
+  if(state->cycle_counter == 0)
+  {
+    state->restart_light = 1;
+    state->dsky_dirty    = 1;
+  }
 
   // For DOWNRUPT
   if(state->downrupt_time_valid && state->cycle_counter >= state->downrupt_time)
@@ -2175,11 +2241,198 @@ int agc_engine(agc_state_t* state)
     state->downrupt_time_valid   = 0;
   }
 
-  // The first time through the loop, light up the DSKY RESTART light
-  if(state->cycle_counter == 0)
+  // Handle server stuff for socket connections used for i/o channel
+  // communications.  Stuff like listening for clients we only do
+  // every once and a while---nominally, every 100 ms.  Actually
+  // processing input data is done every cycle.
+  if(state->cycle_counter >= state->channel_routine_time)
   {
-    state->restart_light = 1;
+    channel_routine(state);
+    state->channel_routine_time = state->cycle_counter + 020000;
+  }
+
+  state->next_event = state->channel_routine_time;
+  if(state->downrupt_time_valid)
+    schedule_event(state, state->downrupt_time);
+}
+
+//----------------------------------------------------------------------------
+// Idle-loop detection.  Called after every instruction.  The first
+// instruction after the search is (re)started becomes the candidate loop
+// head; if Z comes back round to it within IDLE_MAX_INSTRUCTIONS with the
+// same registers, having accessed NEWJOB and without any interrupt or I/O
+// instruction (other than on L, Q or the superbank bits, which are all inside
+// the CPU), erasable memory is snapshotted.  If the next trip round leaves
+// erasable memory unchanged as well, the loop is the executive's idle loop
+// and nothing but an interrupt can get the CPU out of it.
+
+static inline void idle_check(
+  agc_state_t* state, uint16_t ext_ppcode, uint16_t channel, int executed_tc)
+{
+  agc_idle_t* idle = &state->idle;
+
+  if(
+    state->in_isr
+    || (ext_ppcode >= 0100 && ext_ppcode <= 0107 && channel != 01
+        && channel != 02 && channel != 07))
+  {
+    idle->stage = IDLE_SEARCHING;
+    idle->count = IDLE_MAX_INSTRUCTIONS;
+    return;
   }
+  idle->seen |= executed_tc ? IDLE_SEEN_TC : IDLE_SEEN_NON_TC;
+
+  if(
+    idle->count < IDLE_MAX_INSTRUCTIONS && mem0(RegZ) == idle->z
+    && mem0(RegA) == idle->a && mem0(RegL) == idle->l
+    && mem0(RegQ) == idle->q && mem0(RegBB) == idle->bb)
+  {
+    if(
+      (idle->seen & IDLE_SEEN_NEWJOB) && state->allow_interrupt
+      && !state->extra_code && state->index_value == AGC_P0
+      && value_ovf(mem0(RegA)) == AGC_P0)
+    {
+      if(
+        idle->stage != IDLE_SEARCHING
+        && !memcmp(idle->erasable, state->erasable, sizeof(idle->erasable)))
+      {
+        idle->stage = IDLE_CONFIRMED;
+        idle->loop  = idle->seen;
+      }
+      else
+      {
+        memcpy(idle->erasable, state->erasable, sizeof(idle->erasable));
+        idle->stage = IDLE_VERIFYING;
+      }
+    }
+    else
+      idle->stage = IDLE_SEARCHING;
+    idle->count = 0;
+    idle->seen  = 0;
+    return;
+  }
+
+  if(++idle->count >= IDLE_MAX_INSTRUCTIONS)
+  {
+    // Start again, with this instruction as the candidate loop head.
+    idle->stage = IDLE_SEARCHING;
+    idle->count = 0;
+    idle->seen  = 0;
+    idle->z     = mem0(RegZ);
+    idle->a     = mem0(RegA);
+    idle->l     = mem0(RegL);
+    idle->q     = mem0(RegQ);
+    idle->bb    = mem0(RegBB);
+  }
+}
+
+// Let n machine cycles pass in the idle loop.
+static void idle_advance(agc_state_t* state, uint64_t n)
+{
+  state->cycle_counter += n;
+  state->scale_counter += SCALER_DIVIDER * n;
+  state->dsky_timer += SCALER_DIVIDER * n;
+  state->extra_delay = state->extra_delay > n ? state->extra_delay - n : 0;
+  state->cdu_checker         = (state->cdu_checker + n) % NUM_CDU_FIFOS;
+  state->imu_cdu_count += n;
+#ifdef GYRO_TIMING_SIMULATED
+  state->gyro_timer = (state->gyro_timer + GYRO_DIVIDER * n) % GYRO_OVERFLOW;
+#else
+  state->gyro_timer = (state->gyro_timer + GYRO_DIVIDER * n) % (GYRO_BURST * GYRO_OVERFLOW);
+#endif
+}
+
+static int interrupt_pending(agc_state_t* state)
+{
+  for(int i = 1; i <= NUM_INTERRUPT_TYPES; i++)
+    if(state->interrupt_requests[i])
+      return 1;
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+// Skip through a confirmed idle loop for up to max_cycles machine cycles.
+// The CPU stays parked at the loop head while everything that is not the
+// loop itself keeps going: the scaler and the TIME counters it drives, the
+// alarms (which the loop would have kept quiet), and the DSKY lights.  The
+// skip stops at the first cycle where anything else is due -- an interrupt
+// request, a scheduled event, a CDU pulse, a DSKY flash, input waiting in
+// ringbuffer_in, or output put into ringbuffer_out.
+//
+// Returns:
+//      the number of machine cycles skipped.
+
+static uint64_t idle_fast_forward(agc_state_t* state, uint64_t max_cycles)
+{
+  agc_idle_t* idle     = &state->idle;
+  int         out_head = ringbuffer_head(&state->ringbuffer_out);
+  uint64_t    skipped  = 0;
+
+  while(
+    !state->standby && !(input(014) & 077740) && state->gyro_count == 0
+    && ringbuffer_empty(&state->ringbuffer_in) && !interrupt_pending(state))
+  {
+    uint64_t limit = max_cycles - skipped;
+    if(state->next_event <= state->cycle_counter || state->cdu_due <= state->cycle_counter + 1)
+      limit = 0;
+    if(state->next_event - state->cycle_counter < limit)
+      limit = state->next_event - state->cycle_counter;
+    if(state->cdu_due - 1 - state->cycle_counter < limit)
+      limit = state->cdu_due - 1 - state->cycle_counter;
+    if((DSKY_OVERFLOW - 1 - state->dsky_timer) / SCALER_DIVIDER < limit)
+      limit = (DSKY_OVERFLOW - 1 - state->dsky_timer) / SCALER_DIVIDER;
+
+    // Cycles until the scaler next overflows.
+    uint64_t step = 0;
+    if(state->scale_counter < SCALER_OVERFLOW)
+      step = (SCALER_OVERFLOW - state->scale_counter + SCALER_DIVIDER - 1)
+        / SCALER_DIVIDER;
+    if(step > limit)
+    {
+      idle_advance(state, limit);
+      skipped += limit;
+      break;
+    }
+    idle_advance(state, step);
+    skipped += step;
+
+    handle_counter_timers(state);
+    if(input(032) & 020000)
+    {
+      state->sby_pressed       = 0;
+      state->sby_still_pressed = 0;
+    }
+    // The loop itself would have cleared these before the scaler next
+    // checks them.
+    state->rupt_lock      = 0;
+    state->night_watchman = 0;
+    if(idle->loop & IDLE_SEEN_TC)
+      state->no_tc = 0;
+    if(idle->loop & IDLE_SEEN_NON_TC)
+      state->tc_trap = 0;
+    if(state->dsky_dirty)
+      update_dsky(state);
+
+    // A GOJAM moves Z away from the loop.
+    if(mem0(RegZ) != idle->z || ringbuffer_head(&state->ringbuffer_out) != out_head)
+      break;
+  }
+
+  // Unless the whole allowance was used up with the CPU still parked in the
+  // loop, it has to go round again before the next skip.
+  if(skipped < max_cycles || mem0(RegZ) != idle->z)
+    idle->stage = IDLE_VERIFYING;
+  return skipped;
+}
+
+static inline int engine_cycle(agc_state_t* state)
+{
+  //int Operand;
+  //int OverflowQ, Qumulator;
+  // Keep track of TC executions for the TC Trap alarm
+
+  if(state->cycle_counter >= state->next_event)
+    handle_events(state);
 
   state->cycle_counter++;
 
@@ -2193,20 +2446,14 @@ int agc_engine(agc_state_t* state)
 
   //-------------------------------------------------------------------------
 
-  // Handle server stuff for socket connections used for i/o channel
-  // communications.  Stuff like listening for clients we only do
-  // every once and a while---nominally, every 100 ms.  Actually
-  // processing input data is done every cycle.
-  if(state->channel_routine_count == 0)
-    channel_routine(state);
-  state->channel_routine_count = ((state->channel_routine_count + 1) & 017777);
-
-  // Update the various hardware-driven DSKY lights
-  update_dsky(state);
+  // Update the various hardware-driven DSKY lights, if anything feeding
+  // them has changed or the flash period has elapsed.
+  if(state->dsky_dirty || state->dsky_timer >= DSKY_OVERFLOW)
+    update_dsky(state);
 
   // Get data from input channels.  Return immediately if a unprogrammed
   // counter-increment was performed.
-  if(agc_channel_input(state))
+  if(!ringbuffer_empty(&state->ringbuffer_in) && agc_channel_input(state))
     return (0);
 
   //----------------------------------------------------------------------
@@ -2232,8 +2479,10 @@ int agc_engine(agc_state_t* state)
 
   //----------------------------------------------------------------------
   // Take care of any PCDU or MCDU operations that are lingering in CDU
-  // FIFOs.
-  if(sdu_fifo(state))
+  // FIFOs.  Until one of them is due, only the round-robin has to advance.
+  if(state->cycle_counter < state->cdu_due)
+    state->cdu_checker = (state->cdu_checker + 1) % NUM_CDU_FIFOS;
+  else if(sdu_fifo(state))
   {
     // A CDU counter was serviced, so a cycle was used up, and we must
     // return.
@@ -2246,7 +2495,8 @@ int agc_engine(agc_state_t* state)
     state->sby_still_pressed = 0;
   }
 
-  if(!handle_counter_timers(state))
+  // The counter-timers only have work to do once per 1/3200 second.
+  if(state->scale_counter >= SCALER_OVERFLOW && !handle_counter_timers(state))
     return 0;
 
   // If we're in standby mode, this is all we can accomplish --
@@ -2275,26 +2525,61 @@ int agc_engine(agc_state_t* state)
   // indicate the next instruction to be executed. The Z register is 16
   // bits long, but its value is transferred to the 12-bit S regsiter for
   // addressing, so the upper bits are lost.
-  uint16_t pc         = mem0(RegZ) & 07777;
-  int16_t* where_word = find_memory_word(state, pc);
+  uint16_t pc = mem0(RegZ) & 07777;
+  int16_t* where_word;
 
-  // Fetch the instruction itself.
+  // Fetch the instruction itself.  Unindexed fetches from fixed memory come
+  // straight out of the predecoded table.
   uint16_t inst;
-  if(state->substitute_instruction)
-    inst = mem0(RegBRUPT);
+  uint16_t ext_ppcode;
+  int      timing;
+  // Declared ahead of the interrupt vectoring below, whose goto AllDone
+  // skips the instruction but not the bookkeeping that follows it.
+  uint16_t address_9      = 0;
+  int      tc_transient   = 0;
+  int      KeepExtraCode  = 0;
+  int      executed_tc    = 0;
+  int      just_took_bzf  = 0;
+  int      just_took_bzmf = 0;
+  if(pc >= 02000 && !state->substitute_instruction && state->index_value == AGC_P0)
+  {
+    int                  bank    = fixed_bank(state, pc);
+    const agc_decoded_t* decoded = &state->decoded[bank][pc & 01777];
+    where_word                   = (int16_t*)&state->fixed[bank][pc & 01777];
+    inst                         = decoded->inst;
+    ext_ppcode                   = decoded->ext_ppcode;
+    timing                       = decoded->timing;
+    if(ext_ppcode & DECODED_PARITY_FAIL)
+    {
+      ext_ppcode &= ~DECODED_PARITY_FAIL;
+      if(state->check_parity)
+      {
+        state->parity_fail = 1;
+        input(077) |= CH77_PARITY_FAIL;
+      }
+    }
+  }
   else
   {
-    // The index is sometimes positive and sometimes negative.  What to
-    // do if the result has overflow, I can't say.  I arbitrarily
-    // overflow-correct it.
-    inst = overflow_corrected(add_sp_16(
-      sign_extend(state->index_value), sign_extend(*where_word)));
+    where_word = find_memory_word(state, pc);
+    if(state->substitute_instruction)
+      inst = mem0(RegBRUPT);
+    else
+    {
+      // The index is sometimes positive and sometimes negative.  What to
+      // do if the result has overflow, I can't say.  I arbitrarily
+      // overflow-correct it.
+      inst = overflow_corrected(add_sp_16(
+        sign_extend(state->index_value), sign_extend(*where_word)));
+    }
+    inst &= 077777;
+    ext_ppcode = inst >> 9; //2;
+    timing     = InstructionTiming[inst >> 10]
+      | (ExtracodeTiming[inst >> 10] << 4);
   }
-  inst &= 077777;
 
   uint16_t s_extra_code = state->extra_code;
 
-  uint16_t ext_ppcode = inst >> 9; //2;
   if(s_extra_code)
     ext_ppcode |= 0100;
 
@@ -2361,11 +2646,11 @@ int agc_engine(agc_state_t* state)
 
   if(!state->pend_flag)
   {
-    int i = inst >> 10;
+    int i;
     if(state->extra_code)
-      i = ExtracodeTiming[i];
+      i = timing >> 4;
     else
-      i = InstructionTiming[i];
+      i = timing & 017;
     if(i)
     {
       state->pend_flag  = 1;
@@ -2392,10 +2677,9 @@ int agc_engine(agc_state_t* state)
   // executed (really, it happens at the end of the previous instruction).
   mem0(RegZ) = state->next_z;
 
-  uint16_t address_12   = inst & MASK12;
-  uint16_t address_10   = inst & MASK10;
-  uint16_t address_9    = inst & MASK9;
-  int      tc_transient = 0;
+  uint16_t address_12 = inst & MASK12;
+  uint16_t address_10 = inst & MASK10;
+  address_9           = inst & MASK9;
   // A BZF followed by an instruction other than EXTEND causes a TCF0 transient
   if(state->took_bzf && !((ext_ppcode == 000) && (address_12 == 6)))
     tc_transient = 1;
@@ -2403,10 +2687,49 @@ int agc_engine(agc_state_t* state)
   // Parse the instruction.  Refer to p.34 of 1689.pdf for an easy
   // picture of what follows.
   int16_t op_16;
-  int     ValueK, KeepExtraCode = 0;
-  int     executed_tc    = 0;
-  int     just_took_bzf  = 0;
-  int     just_took_bzmf = 0;
+  int     ValueK;
+#ifdef AGC_THREADED_DISPATCH
+  // Jump straight to the handler for this opcode instead of going through
+  // the switch below.
+  static const void* const dispatch_table[0200] = {
+    [000 ... 007]   = &&op_tc,
+    [010 ... 011]   = &&op_ccs,
+    [012 ... 017]   = &&op_tcf,
+    [020 ... 021]   = &&op_das,
+    [022 ... 023]   = &&op_lxch,
+    [024 ... 025]   = &&op_incr,
+    [026 ... 027]   = &&op_ads,
+    [030 ... 037]   = &&op_ca,
+    [040 ... 047]   = &&op_cs,
+    [050 ... 051]   = &&op_index,
+    [052 ... 053]   = &&op_dxch,
+    [054 ... 055]   = &&op_ts,
+    [056 ... 057]   = &&op_xch,
+    [060 ... 067]   = &&op_ad,
+    [070 ... 077]   = &&op_mask,
+    [0100]          = &&op_read,
+    [0101]          = &&op_write,
+    [0102]          = &&op_rand,
+    [0103]          = &&op_wand,
+    [0104]          = &&op_ror,
+    [0105]          = &&op_wor,
+    [0106]          = &&op_rxor,
+    [0107]          = &&op_edrupt,
+    [0110 ... 0111] = &&op_dv,
+    [0112 ... 0117] = &&op_bzf,
+    [0120 ... 0121] = &&op_msu,
+    [0122 ... 0123] = &&op_qxch,
+    [0124 ... 0125] = &&op_aug,
+    [0126 ... 0127] = &&op_dim,
+    [0130 ... 0137] = &&op_dca,
+    [0140 ... 0147] = &&op_dcs,
+    [0150 ... 0157] = &&op_index_ext,
+    [0160 ... 0161] = &&op_su,
+    [0162 ... 0167] = &&op_bzmf,
+    [0170 ... 0177] = &&op_mp,
+  };
+  goto* dispatch_table[ext_ppcode];
+#endif
   switch(ext_ppcode)
   {
     case 000: // TC.
@@ -2417,6 +2740,7 @@ int agc_engine(agc_state_t* state)
     case 005:
     case 006:
     case 007:
+    OPCODE(op_tc)
       // TC instruction (1 MCT).
       ValueK = address_12; // Convert AGC numerical format to native CPU format.
       if(ValueK == 3) // RELINT instruction.
@@ -2453,6 +2777,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 010: // CCS.
     case 011:
+    OPCODE(op_ccs)
       // CCS instruction (2 MCT).
       // Figure out where the data is stored, and fetch it.
       if(address_10 < REG16)
@@ -2495,6 +2820,7 @@ int agc_engine(agc_state_t* state)
     case 015:
     case 016:
     case 017:
+    OPCODE(op_tcf)
       // TCF instruction (1 MCT).
       state->next_z = address_12;
       // THAT was easy ... too easy ...
@@ -2502,6 +2828,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 020: // DAS.
     case 021:
+    OPCODE(op_das)
       //DasInstruction:
       // DAS instruction (3 MCT).
       {
@@ -2558,6 +2885,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 022: // LXCH.
     case 023:
+    OPCODE(op_lxch)
       // "LXCH K" instruction (2 MCT).
       if(IsL(address_10))
         break;
@@ -2586,6 +2914,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 024: // INCR.
     case 025:
+    OPCODE(op_incr)
       // INCR instruction (2 MCT).
       {
         int Sum;
@@ -2602,6 +2931,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 026: // ADS.  Reviewed against Blair-Smith.
     case 027:
+    OPCODE(op_ads)
       // ADS instruction (2 MCT).
       {
         where_word = find_memory_word(state, address_10);
@@ -2629,6 +2959,7 @@ int agc_engine(agc_state_t* state)
     case 035:
     case 036:
     case 037:
+    OPCODE(op_ca)
       if(IsA(address_12)) // NOOP
         break;
       if(address_12 < REG16)
@@ -2648,6 +2979,7 @@ int agc_engine(agc_state_t* state)
     case 045:
     case 046:
     case 047:
+    OPCODE(op_cs)
       tc_transient = 1; // CS causes transients on the TC0 line
 
       if(IsA(address_12)) // COM
@@ -2666,6 +2998,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 050: // INDEX
     case 051:
+    OPCODE(op_index)
       if(address_10 == 017)
         goto Resume;
       if(address_10 < REG16)
@@ -2684,6 +3017,7 @@ int agc_engine(agc_state_t* state)
     case 0155:
     case 0156:
     case 0157:
+    OPCODE(op_index_ext)
       if(address_12 == 017 << 1)
       {
       Resume:
@@ -2705,6 +3039,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 052: // DXCH
     case 053:
+    OPCODE(op_dxch)
       tc_transient = 1; // DXCH causes transients on the TCF0 line
 
       // Remember, in the following comparisons, that the address is pre-incremented.
@@ -2749,6 +3084,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 054: // TS
     case 055:
+    OPCODE(op_ts)
       tc_transient = 1;   // TS causes transients on the TCF0 line
       if(IsA(address_10)) // OVSK
       {
@@ -2777,6 +3113,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 056: // XCH
     case 057:
+    OPCODE(op_xch)
       tc_transient = 1; // XCH causes transients on the TCF0 line
       if(IsA(address_10))
         break;
@@ -2800,6 +3137,7 @@ int agc_engine(agc_state_t* state)
     case 065:
     case 066:
     case 067:
+    OPCODE(op_ad)
       if(IsA(address_12)) // DOUBLE
         acc = add_sp_16(acc, acc);
       else if(address_12 < REG16)
@@ -2820,6 +3158,7 @@ int agc_engine(agc_state_t* state)
     case 075:
     case 076:
     case 077:
+    OPCODE(op_mask)
       if(address_12 < REG16)
         mem0(RegA) = acc & mem0(address_12);
       else
@@ -2830,18 +3169,21 @@ int agc_engine(agc_state_t* state)
       }
       break;
     case 0100: // READ
+    OPCODE(op_read)
       if(IsL(address_9) || IsQ(address_9))
         mem0(RegA) = mem0(address_9);
       else
         mem0(RegA) = sign_extend(read_io(state, address_9));
       break;
     case 0101: // WRITE
+    OPCODE(op_write)
       if(IsL(address_9) || IsQ(address_9))
         mem0(address_9) = acc;
       else
         cpu_write_io(state, address_9, overflow_corrected(acc));
       break;
     case 0102: // RAND
+    OPCODE(op_rand)
       if(IsL(address_9) || IsQ(address_9))
         mem0(RegA) = (acc & mem0(address_9));
       else
@@ -2852,6 +3194,7 @@ int agc_engine(agc_state_t* state)
       }
       break;
     case 0103: // WAND
+    OPCODE(op_wand)
       if(IsL(address_9) || IsQ(address_9))
         mem0(RegA) = mem0(address_9) = (acc & mem0(address_9));
       else
@@ -2863,6 +3206,7 @@ int agc_engine(agc_state_t* state)
       }
       break;
     case 0104: // ROR
+    OPCODE(op_ror)
       if(IsL(address_9) || IsQ(address_9))
         mem0(RegA) = (acc | mem0(address_9));
       else
@@ -2873,6 +3217,7 @@ int agc_engine(agc_state_t* state)
       }
       break;
     case 0105: // WOR
+    OPCODE(op_wor)
       if(IsL(address_9) || IsQ(address_9))
         mem0(RegA) = mem0(address_9) = (acc | mem0(address_9));
       else
@@ -2884,6 +3229,7 @@ int agc_engine(agc_state_t* state)
       }
       break;
     case 0106: // RXOR
+    OPCODE(op_rxor)
       if(IsL(address_9) || IsQ(address_9))
         mem0(RegA) = (acc ^ mem0(address_9));
       else
@@ -2894,11 +3240,13 @@ int agc_engine(agc_state_t* state)
       }
       break;
     case 0107: // EDRUPT
+    OPCODE(op_edrupt)
       // It shouldn't be possible to get here, since EDRUPT is treated
       // as an interrupt above.
       break;
     case 0110: // DV
     case 0111:
+    OPCODE(op_dv)
     {
       int16_t AccPair[2], AbsA, AbsL, AbsK, Div16;
       int     Dividend, Divisor, Quotient, Remainder;
@@ -3023,6 +3371,7 @@ int agc_engine(agc_state_t* state)
     case 0115:
     case 0116:
     case 0117:
+    OPCODE(op_bzf)
       //Operand16 = OverflowCorrected (Accumulator);
       //if (Operand16 == AGC_P0 || Operand16 == AGC_M0)
       if(acc == 0 || acc == 0177777)
@@ -3033,6 +3382,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 0120: // MSU
     case 0121:
+    OPCODE(op_msu)
     {
       unsigned ui, uj;
       int      diff;
@@ -3068,6 +3418,7 @@ int agc_engine(agc_state_t* state)
     break;
     case 0122: // QXCH
     case 0123:
+    OPCODE(op_qxch)
       if(IsQ(address_10))
         break;
       if(IsReg(address_10, RegZERO)) // ZQ
@@ -3090,6 +3441,7 @@ int agc_engine(agc_state_t* state)
       break;
     case 0124: // AUG
     case 0125:
+    OPCODE(op_aug)
     {
       int Sum;
       int Operand16, Increment;
@@ -3115,6 +3467,7 @@ int agc_engine(agc_state_t* state)
     break;
     case 0126: // DIM
     case 0127:
+    OPCODE(op_dim)
     {
       int Sum;
       int Operand16, Increment;
@@ -3145,6 +3498,7 @@ int agc_engine(agc_state_t* state)
     case 0135:
     case 0136:
     case 0137:
+    OPCODE(op_dca)
       if(IsL(address_12))
       {
         mem0(RegL) = sign_extend(overflow_corrected(mem0(RegL)));
@@ -3175,6 +3529,7 @@ int agc_engine(agc_state_t* state)
     case 0145:
     case 0146:
     case 0147:
+    OPCODE(op_dcs)
       if(IsL(address_12)) // DCOM
       {
         mem0(RegA) = ~acc;
@@ -3202,6 +3557,7 @@ int agc_engine(agc_state_t* state)
     // For 0150..0157 see the INDEX instruction above.
     case 0160: // SU
     case 0161:
+    OPCODE(op_su)
       if(IsA(address_10))
         acc = sign_extend(AGC_M0);
       else if(address_10 < REG16)
@@ -3220,6 +3576,7 @@ int agc_engine(agc_state_t* state)
     case 0165:
     case 0166:
     case 0167:
+    OPCODE(op_bzmf)
       //Operand16 = OverflowCorrected (Accumulator);
       //if (Operand16 == AGC_P0 || IsNegativeSP (Operand16))
       if(acc == 0 || 0 != (acc & 0100000))
@@ -3236,6 +3593,7 @@ int agc_engine(agc_state_t* state)
     case 0175:
     case 0176:
     case 0177:
+    OPCODE(op_mp)
     {
       // For MP A (i.e., SQUARE) the accumulator is NOT supposed to
       // be overflow-corrected.  I do it anyway, since I don't know
@@ -3325,6 +3683,51 @@ AllDone:
 
     state->took_bzf  = just_took_bzf;
     state->took_bzmf = just_took_bzmf;
+
+    if(state->fast_idle)
+      idle_check(state, ext_ppcode, address_9, executed_tc);
   }
   return (0);
 }
+
+// Executes a single machine cycle.  Coalesced display and relay writes are
+// flushed into ringbuffer_out right away, so callers that step the engine
+// one cycle at a time see them as soon as they are made.
+int agc_engine(agc_state_t* state)
+{
+  int result = engine_cycle(state);
+  if(state->output_dirty)
+    agc_channel_flush(state);
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+// Execute up to n_cycles machine cycles back to back, so that callers pacing
+// the simulation against wall time need to do their arithmetic only once per
+// slice rather than once per cycle.  The run stops early as soon as the CPU
+// has put something into its ringbuffer_out, so that the peripherals can
+// react to it promptly.  Coalesced display and relay writes do not stop the
+// run; they are flushed into ringbuffer_out once at its end.
+//
+// Returns:
+//      the number of machine cycles actually executed.
+
+uint64_t agc_engine_run(agc_state_t* state, uint64_t n_cycles)
+{
+  int      out_head = ringbuffer_head(&state->ringbuffer_out);
+  uint64_t cycles;
+  for(cycles = 0; cycles < n_cycles;)
+  {
+    if(state->idle.stage == IDLE_CONFIRMED)
+      cycles += idle_fast_forward(state, n_cycles - cycles);
+    else
+    {
+      engine_cycle(state);
+      cycles++;
+    }
+    if(ringbuffer_head(&state->ringbuffer_out) != out_head)
+      break;
+  }
+  agc_channel_flush(state);
+  return cycles;
+}
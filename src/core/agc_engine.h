@@ -142,6 +142,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "ringbuffer.h"
+
 //----------------------------------------------------------------------------
 // Constants.
 
@@ -274,8 +276,104 @@
 #define DL_LM_AGS_INITIALIZATION_UPDATE 10
 
 #define mem0(reg) state->erasable[0][reg]
+
+// Writes to erasable memory are tracked in pages of AGC_PAGE_WORDS words, one
+// bit each in agc_state_t.erasable_dirty, so that snapshots, diffs and
+// watchpoints only need to look at the pages that changed.  Page 0 holds the
+// central registers, which change with every instruction: it always counts
+// as written, and the writes to it are not tracked.  offset may run past the
+// end of bank, as mem0() addresses do.
+#define AGC_PAGE_WORDS 040
+#define AGC_PAGES (8 * 0400 / AGC_PAGE_WORDS)
+#define erasable_written(state, bank, offset) \
+  ((state)->erasable_dirty |= 1ull << (((bank) * 0400 + (offset)) / AGC_PAGE_WORDS))
+#define mem0_written(reg) erasable_written(state, 0, reg)
 #define input(reg) state->input_channel[reg]
 
+// Packed ROM image, ready to be used in place: an agc_rom_header_t followed
+// by fixed memory in bank order 0, 1, 2, ... as host words with the parity
+// bit stripped, then the parity bits, one per word, and optionally the
+// predecoded table for all AGC_ROM_BANKS banks.  agc_pack_rom() makes it from
+// a yaYUL image, whose banks are in the order 2, 3, 0, 1, 4, ... as big endian
+// words with the parity bit at the bottom; the agc_rom tool adds the name and
+// the predecoded table.  The table depends on the engine's timing tables, so
+// the version has to change with them.
+#define AGC_ROM_MAGIC   0x52434741 // "AGCR"
+#define AGC_ROM_VERSION 2
+#define AGC_ROM_PARITY  0x0001 // Parity bits are set; check them.
+#define AGC_ROM_DECODED 0x0002 // The predecoded table is included.
+#define AGC_ROM_BANKS   40
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t flags;
+  uint32_t banks;     // Fixed banks in the image, 0 to banks - 1.
+  uint32_t crc;       // CRC-32 of the yaYUL image it was packed from.
+  uint32_t image_crc; // CRC-32 of everything after the header.
+  char     name[32];  // Program name, e.g. "Colossus249", NUL padded.
+} agc_rom_header_t;
+
+// Fixed memory never changes once the ROM has been loaded, so every word of
+// it is decoded up front by agc_engine_predecode().  Instruction fetches from
+// fixed memory (with no pending INDEX) then need only a single table lookup.
+#define DECODED_PARITY_FAIL 0200 // Flag in ext_ppcode: word fails parity.
+
+typedef struct
+{
+  uint16_t inst;       // Instruction word, 15 bits, parity stripped.
+  uint8_t  ext_ppcode; // Opcode and quartercode (inst >> 9), plus flags.
+  uint8_t  timing;     // Extra MCTs: bits 0-3 normal, bits 4-7 extracode.
+} agc_decoded_t;
+
+// PCDU/MCDU counts for the IMU CDU counters waiting to be applied.  The way
+// the FIFO works is that it can hold an ordered set of + counts and - counts.
+// For example, if it held 7,-5,10, it would mean to apply 7 PCDUs, followed by
+// 5 MCDUs, followed by 10 PCDUs.  If there are too many sign-changes buffered,
+// triggers will be transparently dropped.
+#define MAX_CDU_FIFO_ENTRIES 128
+#define NUM_CDU_FIFOS 3 // Increase to 5 to include OPTX, OPTY.
+
+// Output channels whose packets only carry the latest state, and are
+// coalesced by agc_channel_output(): one slot per relay row of channel 010,
+// then channels 011, 012, 013 and 0163.
+#define NUM_OUTPUT_SLOTS 20
+
+typedef struct
+{
+  int      idx;           // Index of next entry being pulled.
+  int      size;          // Number of entries.
+  int      interval_type; // 0,1,2,0,1,2,...
+  uint64_t next_update; // Cycle count at which next counter update occurs.
+  uint32_t counts[MAX_CDU_FIFO_ENTRIES];
+} cdu_fifo_t;
+
+// The executive spends most of its time going round its idle loop, waiting
+// for the next interrupt.  agc_engine() watches for a loop of instructions
+// that comes back to the same place with the same registers and erasable
+// memory, having touched NEWJOB and done no I/O, and agc_engine_run() then
+// fast-forwards through it to the next timer or interrupt event.
+#define IDLE_SEARCHING 0 // Looking for the loop head to come round again.
+#define IDLE_VERIFYING 1 // Registers repeat; checking erasable memory.
+#define IDLE_CONFIRMED 2 // In the idle loop; safe to fast-forward.
+#define IDLE_MAX_INSTRUCTIONS 64 // Longest loop that is looked for.
+
+#define IDLE_SEEN_NEWJOB 1 // NEWJOB was accessed.
+#define IDLE_SEEN_TC 2     // A TC or TCF was executed.
+#define IDLE_SEEN_NON_TC 4 // Some other instruction was executed.
+
+typedef struct
+{
+  uint8_t  stage;     // IDLE_SEARCHING, IDLE_VERIFYING or IDLE_CONFIRMED.
+  uint8_t  seen;      // IDLE_SEEN_* on this trip round the loop.
+  uint8_t  loop;      // IDLE_SEEN_* on a trip round the confirmed loop.
+  uint16_t count;     // Instructions executed since the loop head.
+  uint16_t z;         // Registers at the loop head.
+  int16_t  a, l, q, bb;
+  int16_t  erasable[8][0400]; // Erasable memory at the loop head.
+} agc_idle_t;
+
 //--------------------------------------------------------------------------
 // Each instance of the AGC CPU simulation has a data structure of type agc_t
 // that contains the CPU's internal states, the complete memory space, and any
@@ -292,11 +390,23 @@ typedef struct
   // use octal, so we do as well.
   //int16_t Memory[RegEND];             // Note use of octal.
   int16_t erasable[8][0400]; // Banks 0,1,2 are "unswitched erasable".
+  uint64_t erasable_dirty;   // Pages written, see erasable_written().
   // There are actually only 36 (0-043) fixed banks, but the calculation of bank
   // numbers by the AGC can theoretically go 0-39 (0-047).  Therefore, I
-  // provide some extra.
-  int16_t  fixed[40][02000]; // Banks 2,3 are "fixed-fixed".
-  uint32_t parities[40 * (02000 / 32)];
+  // provide some extra.  Fixed memory is not copied: each bank points into a
+  // packed ROM image, which on the Pico stays in flash, or into a hot-bank
+  // copy made by agc_cache_rom_banks().  Banks the image does not have read
+  // as zeros.
+  const int16_t*  fixed[AGC_ROM_BANKS]; // Banks 2,3 are "fixed-fixed".
+  const uint32_t* parities;  // One bit per word of the image's banks.
+  uint32_t        rom_banks; // Number of banks in the image.
+  uint32_t        rom_crc;   // CRC-32 of the ROM image, to match snapshots against.
+  void*           rom_copy;  // Packed image allocated by agc_load_rom().
+  // Predecoded copy of fixed memory, a row per bank like fixed: the ROM
+  // image's own table, or else one built by agc_engine_predecode() into
+  // decoded_copy, with the hot banks in agc_cache_rom_banks()'s copy.
+  const agc_decoded_t* decoded[AGC_ROM_BANKS];
+  agc_decoded_t (*decoded_copy)[02000];
   // There are also "input/output channels".  Output channels are acted upon
   // immediately, but input channels are buffered from asynchronous data.
   int16_t input_channel[NUM_CHANNELS];
@@ -335,15 +445,45 @@ typedef struct
   unsigned trap_31b : 1;           // Enable flag for Trap 31B
   unsigned trap_32 : 1;            // Enable flag for Trap 32
   unsigned radar_gate_counter : 4; // Counter tracking radar cycle progress
+  unsigned dsky_dirty : 1; // Set when an input to the DSKY lights may have changed
+  unsigned fast_idle : 1;  // Let agc_engine_run() skip through the idle loop
   uint32_t warning_filter; // Current voltage of the AGC warning filter
   uint64_t /*unsigned long long */ downrupt_time; // Time when next DOWNRUPT occurs.
   int                              downlink;
   int next_z;        // Next value for the Z register
   int scale_counter; // Counter to keep track of scaler increment timing
-  int      channel_routine_count; // Counter to keep track of channel interface routine timing
+  uint64_t channel_routine_time; // Cycle count at which the channel interface routine next runs
+  uint64_t next_event; // Earliest cycle count at which a scheduled event (DOWNRUPT, channel routine) is due
   unsigned dsky_timer; // Timer for DSKY-related timing
   unsigned dsky_flash; // DSKY flash counter (0 = flash occurring)
   uint16_t dsky_channel_163; // Copy of the fake DSKY channel 163
+  agc_idle_t idle; // Idle-loop detection
+  // CDU counter FIFOs, for registers 032, 033, and 034.
+  cdu_fifo_t cdu_fifos[NUM_CDU_FIFOS];
+  int        cdu_checker; // 0, 1, ..., NUM_CDU_FIFOS-1, 0, 1, ...
+  uint64_t   cdu_due;     // Earliest next_update of any non-empty FIFO.
+  // Fine-alignment gyro drive.
+  unsigned gyro_count;
+  unsigned gyro_timer;
+  unsigned old_channel_14;
+  // Coarse-alignment IMU CDU drive.
+  uint64_t imu_cdu_count;
+  unsigned imu_channel_14;
+  int      count_cdu_x, count_cdu_y, count_cdu_z; // In target CPU format.
+  // Last rotational hand controller angles received on channels 0166-0170.
+  int16_t last_rhc_pitch;
+  int16_t last_rhc_yaw;
+  int16_t last_rhc_roll;
+  // Channel traffic between the CPU and the outside world.
+  ringbuffer ringbuffer_in;
+  ringbuffer ringbuffer_out;
+  // Latest value of each coalesced output slot; a dirty slot still has to be
+  // put into ringbuffer_out.
+  uint16_t output_shadow[NUM_OUTPUT_SLOTS];
+  uint32_t output_valid;
+  uint32_t output_dirty;
+  uint32_t output_drops;      // Packets lost because ringbuffer_out was full
+  uint32_t output_high_water; // Most packets ever waiting in ringbuffer_out
 } agc_state_t;
 
 extern int InhibitAlarms;
@@ -354,9 +494,20 @@ extern int CmOrLm;
 //---------------------------------------------------------------------------
 // Function prototypes.
 
-int     agc_engine(agc_state_t* state);
+int      agc_engine(agc_state_t* state);
+uint64_t agc_engine_run(agc_state_t* state, uint64_t n_cycles);
 int     agc_engine_init(agc_state_t* state, const uint8_t* core_image, uint64_t core_size, int all_or_erasable);
 int     agc_load_rom(agc_state_t* Stage, const uint8_t* image, uint64_t image_size);
+int     agc_map_rom(agc_state_t* state, const uint8_t* rom, uint64_t rom_size);
+int     agc_verify_rom(const uint8_t* rom, uint64_t rom_size);
+uint64_t agc_rom_size(const agc_rom_header_t* header);
+void    agc_unload_rom(agc_state_t* state);
+uint64_t agc_take_dirty_pages(agc_state_t* state);
+void    agc_cache_rom_banks(agc_state_t* state, int first, int count, int16_t (*cache)[02000],
+  agc_decoded_t (*decoded_cache)[02000]);
+uint64_t agc_pack_rom_size(uint64_t image_size);
+int      agc_pack_rom(uint8_t* rom, const uint8_t* image, uint64_t image_size);
+void    agc_engine_predecode(agc_state_t* state, agc_decoded_t (*table)[02000]);
 int     read_io(agc_state_t* state, int addr);
 void    write_io(agc_state_t* state, int addr, int val);
 void    cpu_write_io(agc_state_t* state, int addr, int val);
@@ -367,6 +518,7 @@ void unprogrammed_increment(agc_state_t* state, int counter, int inc_type);
 
 // API for yaAGC-to-peripheral communications.
 void agc_channel_output(agc_state_t* state, int channel, int value);
+void agc_channel_flush(agc_state_t* state);
 int  agc_channel_input(agc_state_t* state);
 void channel_routine(agc_state_t* state);
 void request_radar_data(agc_state_t* state);
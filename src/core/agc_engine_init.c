@@ -97,10 +97,12 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "agc.h"
 #include "agc_engine.h"
+#include "snapshot.h"
 
 int initializeSunburst37 = 0;
 
@@ -111,52 +113,72 @@ int initializeSunburst37 = 0;
 //      2 -- ROM image file larger than core memory.
 //      3 -- ROM image file size is odd.
 //      4 -- agc_t structure not allocated.
-//      5 -- File-read error.
+//      5 -- Core image is not a snapshot taken with this ROM.
 //      6 -- Core-dump file not found.
+//      7 -- Not a packed ROM image of this version.
 // Normally, on input the CoreDump filename is NULL, in which case all of the
 // i/o channels, erasable memory, etc., are cleared to their reset values.
 // When the CoreDump is loaded instead, it allows execution to continue precisely
 // from the point at which the CoreDump was created, if AllOrErasable != 0.
 // If AllOrErasable == 0, then only the erasable memory is initialized from the
-// core-dump file.
+// core-dump file. Core dumps are the snapshots written by snapshot_save().
 
-int agc_load_rom(agc_state_t* state, const uint8_t* image, uint64_t image_size)
+// Fixed banks that are not in the ROM image.
+static const int16_t empty_bank[02000];
+
+// Fixed banks in a yaYUL image, which always holds the fixed-fixed banks.
+static uint32_t image_banks(uint64_t image_size)
+{
+  uint64_t banks = (image_size / 2 + 01777) / 02000;
+  return banks < 4 ? 4 : banks;
+}
+
+// Bytes of words and parity bits for banks fixed banks.
+#define ROM_BANK_BYTES(banks) ((uint64_t)(banks) * 02000 * 17 / 8)
+
+uint64_t agc_pack_rom_size(uint64_t image_size)
 {
-  // The following sequence of steps loads the ROM image into the simulated
-  // core memory, in what I think is a pretty obvious way.
+  return sizeof(agc_rom_header_t) + ROM_BANK_BYTES(image_banks(image_size));
+}
 
+// Converts a yaYUL image into the packed format in rom, which has to hold
+// agc_pack_rom_size(image_size) bytes.
+int agc_pack_rom(uint8_t* rom, const uint8_t* image, uint64_t image_size)
+{
   // Must be an integral number of words.
   if(0 != (image_size & 1))
     return 3;
-
-  image_size /= 2; // Convert byte-count to word-count.
-  if(image_size > 36 * 02000)
+  if(image_size / 2 > 36 * 02000)
     return 2;
 
-  if(state == NULL)
-    return 4;
+  memset(rom, 0, agc_pack_rom_size(image_size));
+
+  agc_rom_header_t* header = (agc_rom_header_t*)rom;
+  header->magic   = AGC_ROM_MAGIC;
+  header->version = AGC_ROM_VERSION;
+  header->banks   = image_banks(image_size);
+  header->crc     = snapshot_crc32(0, image, image_size);
 
-  state->check_parity = 0;
-  memset(&state->parities, 0, sizeof(state->parities));
+  int16_t*  fixed    = (int16_t*)(header + 1);
+  uint32_t* parities = (uint32_t*)(fixed + header->banks * 02000);
 
-  const uint16_t* image2 = (const uint16_t*)image;
+  image_size /= 2; // Convert byte-count to word-count.
   for(int bank = 2, j = 0, i = 0; i < image_size; i++)
   {
     // Within the input file, the fixed-memory banks are arranged in the order
     // 2, 3, 0, 1, 4, 5, 6, 7, ..., 35.  Therefore, we have to take a little care
     // reordering the banks.
-    if(bank > 35) return 2;
-    uint16_t raw_value = image2[i] >> 8 | ((image2[i] & 0xff) << 8);
-    uint8_t parity    = raw_value & 1;
+    uint16_t raw_value = image[2 * i] << 8 | image[2 * i + 1];
+    uint8_t  parity    = raw_value & 1;
 
-    state->fixed[bank][j] = raw_value >> 1;
-    state->parities[(bank * 02000 + j) / 32] |= parity << (j % 32);
+    fixed[bank * 02000 + j] = raw_value >> 1;
+    parities[(bank * 02000 + j) / 32] |= parity << (j % 32);
     j++;
 
     // If any of the parity bits are actually set, this must be a ROM built with
     // --hardware. Enable parity checking.
     if(parity)
-      state->check_parity = 1;
+      header->flags |= AGC_ROM_PARITY;
 
     if(j == 02000)
     {
@@ -175,13 +197,153 @@ int agc_load_rom(agc_state_t* state, const uint8_t* image, uint64_t image_size)
     }
   }
 
+  header->image_crc = snapshot_crc32(0, header + 1, ROM_BANK_BYTES(header->banks));
+  return 0;
+}
+
+// Size of the packed image described by header, including the header.
+uint64_t agc_rom_size(const agc_rom_header_t* header)
+{
+  uint64_t size = sizeof(agc_rom_header_t) + ROM_BANK_BYTES(header->banks);
+  if(header->flags & AGC_ROM_DECODED)
+    size += AGC_ROM_BANKS * 02000 * sizeof(agc_decoded_t);
+  return size;
+}
+
+// Checks that a packed image is complete and of this version; its contents
+// are only checked by agc_verify_rom().
+static int rom_check(const uint8_t* rom, uint64_t rom_size)
+{
+  const agc_rom_header_t* header = (const agc_rom_header_t*)rom;
+  if(rom_size < sizeof(agc_rom_header_t) || header->magic != AGC_ROM_MAGIC ||
+     header->version != AGC_ROM_VERSION || header->banks > AGC_ROM_BANKS)
+    return 7;
+  if(rom_size < agc_rom_size(header))
+    return 7;
+  return 0;
+}
+
+// Checks a packed image against its CRC as well; this reads all of it.
+int agc_verify_rom(const uint8_t* rom, uint64_t rom_size)
+{
+  int ret = rom_check(rom, rom_size);
+  if(ret)
+    return ret;
+
+  const agc_rom_header_t* header = (const agc_rom_header_t*)rom;
+  uint64_t                size   = agc_rom_size(header) - sizeof(agc_rom_header_t);
+  return snapshot_crc32(0, header + 1, size) == header->image_crc ? 0 : 7;
+}
+
+// Points fixed memory at a packed ROM image without copying it, so that on
+// the Pico it is read straight from flash.  The image has to stay in place
+// for as long as the state is used.  Only an image without a predecoded
+// table needs RAM, for the table built here; use agc_unload_rom() to release
+// it before mapping another image.
+int agc_map_rom(agc_state_t* state, const uint8_t* rom, uint64_t rom_size)
+{
+  if(state == NULL)
+    return 4;
+
+  int ret = rom_check(rom, rom_size);
+  if(ret)
+    return ret;
+
+  const agc_rom_header_t* header = (const agc_rom_header_t*)rom;
+  const int16_t*          fixed  = (const int16_t*)(header + 1);
+  for(uint32_t bank = 0; bank < AGC_ROM_BANKS; bank++)
+    state->fixed[bank] = bank < header->banks ? fixed + bank * 02000 : empty_bank;
+  state->parities     = (const uint32_t*)(fixed + header->banks * 02000);
+  state->rom_banks    = header->banks;
+  state->rom_crc      = header->crc;
+  state->rom_copy     = NULL;
+  state->decoded_copy = NULL;
+  state->check_parity = (header->flags & AGC_ROM_PARITY) != 0;
+
+  const agc_decoded_t(*table)[02000];
+  if(header->flags & AGC_ROM_DECODED)
+    table = (const agc_decoded_t(*)[02000])(rom + sizeof(agc_rom_header_t) + ROM_BANK_BYTES(header->banks));
+  else
+  {
+    state->decoded_copy = malloc(AGC_ROM_BANKS * sizeof(*state->decoded_copy));
+    if(state->decoded_copy == NULL)
+      return 4;
+    agc_engine_predecode(state, state->decoded_copy);
+    table = (const agc_decoded_t(*)[02000])state->decoded_copy;
+  }
+  for(int bank = 0; bank < AGC_ROM_BANKS; bank++)
+    state->decoded[bank] = table[bank];
+  return 0;
+}
+
+// Loads a yaYUL or packed ROM image into a private copy in RAM, so the image
+// itself can be freed.  A packed image is checked against its CRC first.
+int agc_load_rom(agc_state_t* state, const uint8_t* image, uint64_t image_size)
+{
+  if(state == NULL)
+    return 4;
+
+  const agc_rom_header_t* header = (const agc_rom_header_t*)image;
+  int packed = image_size >= sizeof(agc_rom_header_t) && header->magic == AGC_ROM_MAGIC;
+  if(packed && agc_verify_rom(image, image_size))
+    return 7;
+
+  uint64_t size = packed ? agc_rom_size(header) : agc_pack_rom_size(image_size);
+  uint8_t* rom  = malloc(size);
+  if(rom == NULL)
+    return 4;
+
+  int ret = 0;
+  if(packed)
+    memcpy(rom, image, size);
+  else
+    ret = agc_pack_rom(rom, image, image_size);
+  if(!ret)
+    ret = agc_map_rom(state, rom, size);
+  if(ret)
+  {
+    free(rom);
+    return ret;
+  }
+
+  state->rom_copy = rom;
   return 0;
 }
 
+void agc_unload_rom(agc_state_t* state)
+{
+  free(state->rom_copy);
+  free(state->decoded_copy);
+  state->rom_copy     = NULL;
+  state->decoded_copy = NULL;
+  for(int bank = 0; bank < AGC_ROM_BANKS; bank++)
+  {
+    state->fixed[bank]   = empty_bank;
+    state->decoded[bank] = NULL;
+  }
+  state->rom_banks = 0;
+}
+
+// Copies count banks from first on, and their rows of the predecoded table,
+// into cache and decoded_cache and reads them from there from now on.
+// Instruction fetches go to the table and operands to the banks.  On the
+// Pico, flash is much slower than SRAM for banks that are not in the XIP
+// cache; the fixed-fixed banks 2 and 3 are the busiest.
+void agc_cache_rom_banks(agc_state_t* state, int first, int count, int16_t (*cache)[02000],
+  agc_decoded_t (*decoded_cache)[02000])
+{
+  for(int i = 0; i < count && first + i < AGC_ROM_BANKS; i++)
+  {
+    memcpy(cache[i], state->fixed[first + i], sizeof(cache[i]));
+    memcpy(decoded_cache[i], state->decoded[first + i], sizeof(decoded_cache[i]));
+    state->fixed[first + i]   = cache[i];
+    state->decoded[first + i] = decoded_cache[i];
+  }
+}
+
 int agc_engine_init(agc_state_t* state, const uint8_t* core_image, uint64_t core_size, int all_or_erasable)
 {
-  uint64_t lli;
-  int      ret = 0, i, j, Bank;
+  int ret = 0, i, j, Bank;
 
   // Clear i/o channels.
   for(i = 0; i < NUM_CHANNELS; i++)
@@ -195,6 +357,7 @@ int agc_engine_init(agc_state_t* state, const uint8_t* core_image, uint64_t core
   for(Bank = 0; Bank < 8; Bank++)
     for(j = 0; j < 0400; j++)
       state->erasable[Bank][j] = 0;
+  state->erasable_dirty = ~0ull;
   mem0(RegZ) = 04000; // Initial program counter.
 
   // Set up the CPU state variables that aren't part of normal memory.
@@ -238,11 +401,13 @@ int agc_engine_init(agc_state_t* state, const uint8_t* core_image, uint64_t core
 
   state->next_z                = 0;
   state->scale_counter         = 0;
-  state->channel_routine_count = 0;
+  state->channel_routine_time  = 0;
+  state->next_event            = 0;
 
   state->dsky_timer       = 0;
   state->dsky_flash       = 0;
   state->dsky_channel_163 = 0;
+  state->dsky_dirty       = 1;
 
   state->took_bzf  = 0;
   state->took_bzmf = 0;
@@ -253,6 +418,35 @@ int agc_engine_init(agc_state_t* state, const uint8_t* core_image, uint64_t core
 
   state->radar_gate_counter = 0;
 
+  state->fast_idle  = 1;
+  state->idle.stage = IDLE_SEARCHING;
+  state->idle.count = IDLE_MAX_INSTRUCTIONS;
+
+  memset(state->cdu_fifos, 0, sizeof(state->cdu_fifos));
+  state->cdu_checker = 0;
+  state->cdu_due     = UINT64_MAX;
+
+  state->gyro_count     = 0;
+  state->gyro_timer     = 0;
+  state->old_channel_14 = 0;
+
+  state->imu_cdu_count  = 0;
+  state->imu_channel_14 = 0;
+  state->count_cdu_x    = 0;
+  state->count_cdu_y    = 0;
+  state->count_cdu_z    = 0;
+
+  state->last_rhc_pitch = 0;
+  state->last_rhc_yaw   = 0;
+  state->last_rhc_roll  = 0;
+
+  ringbuffer_init(&state->ringbuffer_in);
+  ringbuffer_init(&state->ringbuffer_out);
+  state->output_valid      = 0;
+  state->output_dirty      = 0;
+  state->output_drops      = 0;
+  state->output_high_water = 0;
+
   if(initializeSunburst37)
   {
     mem0(0067) = 077777;
@@ -264,73 +458,19 @@ int agc_engine_init(agc_state_t* state, const uint8_t* core_image, uint64_t core
   if(core_image == NULL)
     goto Done;
 
-  ret = 5;
-
-  // Load up the i/o channels.
-  for(i = 0; i < NUM_CHANNELS; i++)
-  {
-    //if(1 != scanf("%o", &j))
-      goto Done;
-    if(all_or_erasable)
-      input(i) = j;
-  }
-
-  // Load up erasable memory.
-  for(Bank = 0; Bank < 8; Bank++)
-    for(j = 0; j < 0400; j++)
-    {
-      if(1 != scanf("%o", &i))
-        goto Done;
-      if(all_or_erasable || Bank > 0 || j >= 010)
-        state->erasable[Bank][j] = i;
-    }
-
+  // Resume from a snapshot made by snapshot_save(), either the complete
+  // machine or only its erasable memory. The state is left at its reset
+  // values if the snapshot does not belong to the ROM that is loaded.
   if(all_or_erasable)
+    ret = snapshot_load(state, NULL, NULL, core_image, core_size);
+  else
+    ret = snapshot_load_erasable(state, core_image, core_size);
+  if(ret)
   {
-    // Set up the CPU state variables that aren't part of normal memory.
-    core_image += scanf("%o", &state->cycle_counter);
-    core_image += scanf("%o", &i);
-    state->extra_code = i;
-    core_image += scanf("%o", &i);
-    state->allow_interrupt = i;
-    core_image += scanf("%o", &i);
-    state->pend_flag = i;
-    core_image += scanf("%o", &i);
-    state->pend_delay = i;
-    core_image += scanf("%o", &i);
-    state->extra_delay = i;
-    core_image += scanf("%o", &state->output_channel_7);
-
-    for(j = 0; j < 16; j++)
-    {
-      core_image += scanf("%o", &state->output_channel_10[j]);
-    }
-    core_image += scanf("%o", &i);
-    state->index_value = i;
-    for(j = 0; j < 1 + NUM_INTERRUPT_TYPES; j++)
-    {
-      core_image += scanf("%o", &i);
-      state->interrupt_requests[j] = i;
-    }
-    // Override the above and make DOWNRUPT always enabled at start.
-    state->interrupt_requests[8] = 1;
-    core_image += scanf("%o", &i);
-    state->in_isr = i;
-    core_image += scanf("%o", &i);
-    state->substitute_instruction = i;
-    core_image += scanf("%o", &i);
-    state->downrupt_time_valid = i;
-    core_image += scanf("%o", &i);
-    state->downrupt_time = lli;
-    core_image += scanf("%o", &i);
-    state->downlink = i;
+    agc_engine_init(state, NULL, 0, 0);
+    ret = 5;
   }
 
-  ret = 0;
-
 Done:
   return (ret);
 }
-
-//-------------------------------------------------------------------------------
-// A function for creating a core-dump which can be read by agc_engine_init.
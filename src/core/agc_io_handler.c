@@ -47,22 +47,43 @@
 #include <core/agc.h>
 #include "ringbuffer.h"
 
-int16_t last_rhc_pitch = 0;
-int16_t last_rhc_yaw   = 0;
-int16_t last_rhc_roll  = 0;
+/* Maps an output to its coalescing slot, or returns -1 if every packet of
+ * the channel has to be delivered (counter pulses, gyro and CDU drives).
+ */
+static int output_slot(int channel, int value)
+{
+  switch(channel)
+  {
+    case 010:
+      return (value >> 11) & 017; // One slot per relay row
+    case 011:
+      return 16;
+    case 012:
+      return 17;
+    case 013:
+      return 18;
+    case 0163:
+      return 19;
+    default:
+      return -1;
+  }
+}
 
-static int channel_is_set_up = 0;
+static const uint16_t output_slot_channel[NUM_OUTPUT_SLOTS] = {
+  010, 010, 010, 010, 010, 010, 010, 010, 010, 010,
+  010, 010, 010, 010, 010, 010, 011, 012, 013, 0163};
 
-static void init_dsky_channel(agc_state_t* state)
+static void output_track_high_water(agc_state_t* state)
 {
-  channel_is_set_up = 1;
-
-  ringbuffer_init(&ringbuffer_out);
-  ringbuffer_init(&ringbuffer_in);
+  uint32_t count = (ringbuffer_head(&state->ringbuffer_out)
+                    - ringbuffer_tail(&state->ringbuffer_out))
+                   & RINGBUFFER_MASK;
+  if(count > state->output_high_water)
+    state->output_high_water = count;
 }
 
 /* The simulated AGC CPU calls this function when it wants to output data.  It
- * stores the data in ringbuffer_out so as to not have to call
+ * stores the data in state->ringbuffer_out so as to not have to call
  * a foreign and possibly slow function.  The data is supposed to be read from
  * the ring buffer asynchronously. See also NullAPI.c
  *
@@ -70,9 +91,6 @@ static void init_dsky_channel(agc_state_t* state)
  */
 void agc_channel_output(agc_state_t* state, int channel, int value)
 {
-  if(!channel_is_set_up)
-    init_dsky_channel(state);
-
   // Some output channels have purposes within the CPU, so we have to
   // account for those separately.
   if(channel == 7)
@@ -84,26 +102,73 @@ void agc_channel_output(agc_state_t* state, int channel, int value)
   // Stick data into the RHCCTR registers, if bits 8,9 of channel 013 are set.
   if(channel == 013 && 0600 == (0600 & value) && !CmOrLm)
   {
-    mem0(042) = last_rhc_pitch;
-    mem0(043) = last_rhc_yaw;
-    mem0(044) = last_rhc_roll;
+    mem0(042) = state->last_rhc_pitch;
+    mem0(043) = state->last_rhc_yaw;
+    mem0(044) = state->last_rhc_roll;
+    mem0_written(042);
+  }
+
+  // Display and relay channels only need their latest value: remember it
+  // and let agc_channel_flush() send it, unless it is already known to the
+  // peripherals.
+  int slot = output_slot(channel, value);
+  if(slot >= 0)
+  {
+    uint32_t bit = 1u << slot;
+    if((state->output_valid & bit) && state->output_shadow[slot] == value)
+      return;
+    state->output_shadow[slot] = value;
+    state->output_valid |= bit;
+    state->output_dirty |= bit;
+    return;
   }
 
   packet_t packet = {.channel = channel, .value = value};
-  ringbuffer_put(&ringbuffer_out, (unsigned char*)&packet);
+  if(!ringbuffer_put(&state->ringbuffer_out, &packet))
+    state->output_drops++;
+  else
+    output_track_high_water(state);
+}
+
+/* Puts the pending values of the coalesced output channels into
+ * state->ringbuffer_out in slot order. Slots that do not fit stay
+ * dirty and are sent by a later flush, so these values are never lost.
+ */
+void agc_channel_flush(agc_state_t* state)
+{
+  packet_t packets[NUM_OUTPUT_SLOTS];
+  int      n = 0;
+
+  if(!state->output_dirty)
+    return;
+
+  for(int slot = 0; slot < NUM_OUTPUT_SLOTS; slot++)
+    if(state->output_dirty & (1u << slot))
+    {
+      packets[n].channel = output_slot_channel[slot];
+      packets[n].value   = state->output_shadow[slot];
+      n++;
+    }
+
+  int put = ringbuffer_put_n(&state->ringbuffer_out, packets, n);
+  for(int slot = 0; slot < NUM_OUTPUT_SLOTS && put > 0; slot++)
+    if(state->output_dirty & (1u << slot))
+    {
+      state->output_dirty &= ~(1u << slot);
+      put--;
+    }
+
+  output_track_high_water(state);
 }
 
 /* The simulated AGC CPU calls this function when it wants to input data.
- * The data is read from the ring buffer ringbuffer_in.
+ * The data is read from the ring buffer state->ringbuffer_in.
  * See also NullAPI.c
  */
 int agc_channel_input(agc_state_t* state)
 {
-  if(!channel_is_set_up)
-    init_dsky_channel(state);
-
   packet_t packet;
-  while(ringbuffer_get(&ringbuffer_in, (unsigned char*)&packet))
+  while(ringbuffer_get(&state->ringbuffer_in, &packet))
   {
     // This body of the while loop follows the work done in SocketAPI.c.
     // I removed socket client related code, and refactored and reformatted
@@ -141,6 +206,7 @@ int agc_channel_input(agc_state_t* state)
     {
       mem0(RegINLINK)              = (packet.value & 077777);
       state->interrupt_requests[7] = 1;
+      mem0_written(RegINLINK);
     }
     // Fictitious registers for rotational hand controller (RHC).
     // Note that the RHC angles are not immediately used, but
@@ -149,17 +215,17 @@ int agc_channel_input(agc_state_t* state)
     // enabled and the data requested (bits 8,9 of channel 13).
     else if(packet.channel == 0166)
     {
-      last_rhc_pitch = packet.value;
+      state->last_rhc_pitch = packet.value;
       agc_channel_output(state, packet.channel, packet.value); // echo
     }
     else if(packet.channel == 0167)
     {
-      last_rhc_yaw = packet.value;
+      state->last_rhc_yaw = packet.value;
       agc_channel_output(state, packet.channel, packet.value); // echo
     }
     else if(packet.channel == 0170)
     {
-      last_rhc_roll = packet.value;
+      state->last_rhc_roll = packet.value;
       agc_channel_output(state, packet.channel, packet.value); // echo
     }
   } // while
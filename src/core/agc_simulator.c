@@ -52,12 +52,12 @@
 
 
 /**
-This function executes one cycle of the AGC engine. This is
-a wrapper function to eliminate showing the passing of the
-current engine state. */
-static void sim_exec_engine(sim_t* sim)
+This function executes up to n_cycles cycles of the AGC engine, returning
+early if the AGC produced output. This is a wrapper function to eliminate
+showing the passing of the current engine state. */
+static uint64_t sim_exec_engine(sim_t* sim, uint64_t n_cycles)
 {
-  agc_engine(&sim->state);
+  return agc_engine_run(&sim->state, n_cycles);
 }
 
 /**
@@ -73,7 +73,16 @@ int init_sim(sim_t* sim, opt_t* opt)
     return (6);
 
   /* Set the basic simulator variables */
-  sim->dump_interval = opt->dump_time * sysconf(_SC_CLK_TCK);
+  sim->dump_interval    = opt->dump_time * 1000000ull;
+  sim->history          = NULL;
+  sim->history_interval = SIM_HISTORY_CYCLES;
+  sim->rewind_us        = 0;
+  dsky_init(&sim->dsky);
+  flight_init(&sim->flight, NULL);
+
+  /* Select how engine time follows the host clock */
+  sim->pace  = opt->pace;
+  sim->speed = opt->pace == SIM_PACE_SCALED && opt->speed > 0 ? opt->speed : 1;
 
   /* Set legacy Option variables */
   InhibitAlarms = opt->inhibit_alarms;
@@ -133,28 +142,77 @@ uint64_t mul_fixed_point(uint64_t lhs, uint64_t rhs, uint8_t shift)
 
 #define AGC_PER_US_I17F47 0xa6aaaaaaaaaaa800
 
-void sim_exec(sim_t* sim)
+// Cycles run per slice when the engine is not paced by the host clock,
+// about 12 ms of AGC time between two passes over the peripherals.
+#define SIM_SLICE_CYCLES 1024
+
+void sim_rewind(sim_t* sim, uint64_t us)
 {
-  dsky_t dsky;
-  dsky_init(&dsky);
+  sim->rewind_us += us;
+}
 
-  uint64_t start_us = time_us_64();
+// Goes back to the history frame taken rewind_us ago, if there is one.
+static bool sim_exec_rewind(sim_t* sim)
+{
+  // 11.71875 us per MCT.
+  uint64_t cycles = sim->rewind_us * 64 / 750;
+  uint64_t now    = sim->state.cycle_counter;
+  sim->rewind_us  = 0;
+  if(!sim->history)
+    return false;
+  return history_rewind(sim->history, now > cycles ? now - cycles : 0, &sim->state, &sim->dsky, &sim->flight) ==
+         SNAPSHOT_E_OK;
+}
+
+void sim_exec(sim_t* sim)
+{
+  // A resumed machine is paced from where its snapshot left off.
+  uint64_t start_cycles = sim->state.cycle_counter;
+  uint64_t start_us     = time_us_64();
+  uint64_t next_dump    = start_us + sim->dump_interval;
+  uint64_t next_history = start_cycles;
 
   bool mode = 0;
 
   while(1)
   {
-    //sync cycles with the speed of the agc
-    uint64_t current_us = time_us_64() - start_us;
-    uint64_t desired_ucycles = mul_fixed_point(current_us, AGC_PER_US_I17F47, 47);
-    uint64_t current_ucycles = sim->state.cycle_counter * 1000000;
-
-    if(current_ucycles < desired_ucycles){
-      sim_exec_engine(sim);
-    }else{
-      sim2agc_handle(&sim->state, &dsky);
-      agc2dsky_handle(&sim->state, &dsky);
-      dsky2agc_handle();
+    uint64_t desired_cycles;
+    if(sim->pace == SIM_PACE_UNTHROTTLED)
+      desired_cycles = sim->state.cycle_counter + SIM_SLICE_CYCLES;
+    else
+    {
+      //sync cycles with the speed of the agc, one slice at a time
+      uint64_t current_us = (time_us_64() - start_us) * sim->speed;
+      uint64_t desired_ucycles = mul_fixed_point(current_us, AGC_PER_US_I17F47, 47);
+      desired_cycles = start_cycles + (desired_ucycles + 999999) / 1000000;
+    }
+
+    if(sim->state.cycle_counter < desired_cycles)
+      sim_exec_engine(sim, desired_cycles - sim->state.cycle_counter);
+
+    sim2agc_handle(&sim->state, &sim->dsky, &sim->flight);
+    agc2dsky_handle(&sim->state, &sim->dsky, &sim->flight);
+    if(dsky2agc_handle(&sim->state) & DSKY_REQUEST_REWIND)
+      sim_rewind(sim, SIM_REWIND_US);
+
+    // After a rewind the pacing starts over from the restored cycle count.
+    if(sim->rewind_us && sim_exec_rewind(sim))
+    {
+      start_cycles = sim->state.cycle_counter;
+      start_us     = time_us_64();
+      next_history = start_cycles + sim->history_interval;
+    }
+
+    if(sim->history && sim->state.cycle_counter >= next_history)
+    {
+      history_record(sim->history, &sim->state, &sim->dsky, &sim->flight);
+      next_history = sim->state.cycle_counter + sim->history_interval;
+    }
+
+    if(sim->dump_interval && time_us_64() >= next_dump)
+    {
+      sim_save(sim);
+      next_dump = time_us_64() + sim->dump_interval;
     }
 
     //handle_timer(&dsky);
@@ -41,6 +41,8 @@
 
 #include "agc.h"
 #include "agc_engine.h"
+#include "dsky.h"
+#include "history.h"
 
 #ifdef PICO_BOARD
 #include "pico/stdlib.h"
@@ -58,6 +60,10 @@
 #define SIM_CYCLECOUNT_INC 1
 #define SIM_CYCLECOUNT_AGC 2
 
+#define SIM_PACE_REALTIME 0
+#define SIM_PACE_SCALED 1
+#define SIM_PACE_UNTHROTTLED 2
+
 typedef struct
 {
   char* core;
@@ -68,6 +74,11 @@ typedef struct
   char* cd;
   char* cfg;
   char* fromfile;
+  char* batch;
+  char* select;
+  int   jobs;
+  int   pace;
+  int   speed;
   int   port;
   int   dump_time;
   int   debug_dsky;
@@ -85,12 +96,33 @@ typedef struct
   int   no_resume;
 } opt_t;
 
+// One second of AGC time, the default interval of the rewind history.
+#define SIM_HISTORY_CYCLES (1024000 / 12)
+
+// How far back one rewind goes, in microseconds of AGC time.
+#define SIM_REWIND_US 2000000
+
 typedef struct
 {
-  clock_t     dump_interval;
+  uint64_t    dump_interval;    // Microseconds between snapshots, 0 for none
+  history_t*  history;          // Frames to rewind to, NULL for none
+  uint64_t    history_interval; // AGC cycles between history frames
+  uint64_t    rewind_us;        // Rewind pending, in microseconds of AGC time
+  int         pace;
+  uint64_t    speed;
   agc_state_t state;
+  dsky_t      dsky;
+  flight_t    flight;
 } sim_t;
 
 
 extern int  init_sim(sim_t* sim, opt_t* opt);
 extern void sim_exec(sim_t* sim);
+
+// Asks sim_exec() to go back by us microseconds of AGC time to the history
+// frame taken then, once the current slice is done.
+extern void sim_rewind(sim_t* sim, uint64_t us);
+
+// Called by sim_exec() every dump_interval to save a snapshot of the
+// simulation; each front end stores it in its own way.
+extern void sim_save(sim_t* sim);
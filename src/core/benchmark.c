@@ -0,0 +1,26 @@
+#include "benchmark.h"
+
+#include "ringbuffer.h"
+#include "us_time.h"
+
+/**
+Runs the engine flat out, without any real-time pacing, until it has
+executed n_cycles machine cycles. Channel output is thrown away and idle-loop
+skipping is switched off, so that every cycle is really executed and only
+the cost of the engine itself is measured. Returns the elapsed wall time in
+microseconds. */
+uint64_t agc_benchmark(agc_state_t* state, uint64_t n_cycles)
+{
+  uint64_t target   = state->cycle_counter + n_cycles;
+  uint64_t start_us = time_us_64();
+
+  state->fast_idle = 0;
+
+  while(state->cycle_counter < target)
+  {
+    agc_engine_run(state, target - state->cycle_counter);
+    ringbuffer_init(&state->ringbuffer_out);
+  }
+
+  return time_us_64() - start_us;
+}
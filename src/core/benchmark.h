@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "agc_engine.h"
+
+uint64_t agc_benchmark(agc_state_t* state, uint64_t n_cycles);
@@ -0,0 +1,75 @@
+#include "catalog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+static bool catalog_span_ok(const catalog_span_t* span, uint64_t len)
+{
+  if(!span->size)
+    return true;
+  return span->offset % CATALOG_ALIGN == 0 && span->offset >= sizeof(catalog_header_t) &&
+         span->offset <= len && span->size <= len - span->offset;
+}
+
+bool catalog_name_ok(const char* name)
+{
+  // Names end up in messages and in paths like state/<name>.bin.
+  const char* end = memchr(name, 0, sizeof(((catalog_entry_t*)0)->name));
+  return end && end > name && !memchr(name, '/', end - name);
+}
+
+const catalog_header_t* catalog_map(const uint8_t* data, uint64_t len)
+{
+  if(!data || len < sizeof(catalog_header_t))
+    return NULL;
+
+  const catalog_header_t* catalog = (const catalog_header_t*)data;
+  if(catalog->magic != CATALOG_MAGIC || catalog->version != CATALOG_VERSION ||
+     catalog->count == 0 || catalog->count > CATALOG_ENTRIES || catalog->size > len)
+    return NULL;
+  if(catalog->crc != snapshot_crc32(0, catalog->entries, sizeof(catalog->entries)))
+    return NULL;
+
+  for(int i = 0; i < catalog->count; i++)
+  {
+    const catalog_entry_t* entry = &catalog->entries[i];
+    if(!catalog_name_ok(entry->name) || !entry->rom.size || !catalog_span_ok(&entry->rom, catalog->size) ||
+       !catalog_span_ok(&entry->core, catalog->size) || !catalog_span_ok(&entry->profile, catalog->size))
+      return NULL;
+  }
+  return catalog;
+}
+
+int catalog_find(const catalog_header_t* catalog, const char* name)
+{
+  for(int i = 0; i < catalog->count; i++)
+    if(!strncmp(catalog->entries[i].name, name, sizeof(catalog->entries[i].name)))
+      return i;
+
+  char* end;
+  long  number = strtol(name, &end, 10);
+  if(*name && !*end && number >= 1 && number <= catalog->count)
+    return number - 1;
+  return -1;
+}
+
+const uint8_t* catalog_data(const catalog_header_t* catalog, const catalog_span_t* span)
+{
+  return span->size ? (const uint8_t*)catalog + span->offset : NULL;
+}
+
+int catalog_select(const catalog_header_t* catalog, int index, agc_state_t* state, profile_t* profile)
+{
+  const catalog_entry_t* entry = &catalog->entries[index];
+
+  int error = agc_map_rom(state, catalog_data(catalog, &entry->rom), entry->rom.size);
+  if(error)
+    return error;
+
+  if(profile && entry->profile.size)
+    profile_map(profile, catalog_data(catalog, &entry->profile), entry->profile.size);
+  CmOrLm = (entry->flags & CATALOG_CM) ? 1 : 0;
+  return 0;
+}
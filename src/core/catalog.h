@@ -0,0 +1,69 @@
+#pragma once
+#include <stdbool.h>
+
+#include <stdint.h>
+
+#include "agc_engine.h"
+#include "profile.h"
+
+// Catalog of programs, a catalog_header_t followed by the images its entries
+// point to. Each entry has a packed ROM image, a slot its snapshot is saved
+// to and an optional flight profile, all used in place, so on the Pico one
+// flash image holds several programs and the one to run is picked at boot.
+// Everything the entries point to starts on a CATALOG_ALIGN boundary: a
+// snapshot slot can be erased and rewritten without touching its neighbours.
+#define CATALOG_MAGIC   0x43434741 // "AGCC"
+#define CATALOG_VERSION 1
+#define CATALOG_ENTRIES 8
+#define CATALOG_ALIGN   0x1000 // Flash sector size of the Pico.
+
+// Bytes reserved for each snapshot slot by agc_catalog.
+#define CATALOG_CORE_SLOT 0x4000
+
+// Flags of an entry.
+#define CATALOG_CM 0x0001 // Command Module software, CmOrLm = 1.
+
+typedef struct
+{
+  uint32_t offset; // From the start of the catalog.
+  uint32_t size;   // 0 if the entry has none.
+} catalog_span_t;
+
+typedef struct
+{
+  char           name[32]; // NUL padded, from the ROM image.
+  uint32_t       flags;
+  catalog_span_t rom;
+  catalog_span_t core; // Snapshot slot, erased (0xff) until one is saved.
+  catalog_span_t profile;
+} catalog_entry_t;
+
+typedef struct
+{
+  uint32_t        magic;
+  uint16_t        version;
+  uint16_t        count;
+  uint32_t        size; // Of the whole catalog.
+  uint32_t        crc;  // CRC-32 of entries.
+  catalog_entry_t entries[CATALOG_ENTRIES];
+} catalog_header_t;
+
+// Whether name, a catalog_entry_t.name, is NUL terminated, not empty and
+// free of '/'.
+bool catalog_name_ok(const char* name);
+
+// Checks a catalog image of len bytes and returns its header, NULL if it is
+// not a catalog of this version, an entry has a bad name or points outside
+// of it.
+const catalog_header_t* catalog_map(const uint8_t* data, uint64_t len);
+
+// Index of the entry called name, or numbered name from 1, -1 if none is.
+int catalog_find(const catalog_header_t* catalog, const char* name);
+
+// Data of a span of the catalog, NULL if the span is empty.
+const uint8_t* catalog_data(const catalog_header_t* catalog, const catalog_span_t* span);
+
+// Makes entry index the running program: maps its ROM into state and, if it
+// has one and profile is not NULL, its flight profile, both in place, and
+// sets CmOrLm. Returns the error of agc_map_rom().
+int catalog_select(const catalog_header_t* catalog, int index, agc_state_t* state, profile_t* profile);
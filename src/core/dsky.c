@@ -8,6 +8,7 @@
 #include "agc_engine.h"
 #include "agc_simulator.h"
 #include <core/ringbuffer.h>
+#include "imu.h"
 #include "profile.h"
 
 #include <sys/time.h>
@@ -19,46 +20,46 @@ long long current_time_millis() {
 }
 
 
-double imu_angle[3] = {0};
-double pimu[3]      = {0};
-
 #define DEG_TO_RAD (M_PI / 180)
 #define RAD_TO_DEG (180 / M_PI)
 #define CA_ANGLE (0.043948 * DEG_TO_RAD)
 #define FA_ANGLE (0.617981 / 3600.0 * DEG_TO_RAD)
-#define ANGLE_INCR (360.0 / 32768 * DEG_TO_RAD)
-#define PIPA_INCR (0.0585) // m/s per each PIPA pulse
 
-double adjust(double x, double a, double b)
-{
-  return x - (b - a) * floor((x - a) / (b - a));
-}
+// The flight model is integrated every 10 centiseconds of TIME5; the profile
+// is interpolated in between its own samples, whatever their spacing.
+#define FLIGHT_STEP_CS 10
 
-void modify_gimbal_angle(agc_state_t* state, uint16_t axis, double delta)
+// Adds pulses to the CDU counters (26 = 0x32 = CDUX) of the erasable memory.
+static void feed_cdu(agc_state_t* state, uint16_t axis, int16_t pulses)
 {
-  // ---- Calculate New Angle ----
-  imu_angle[axis] = adjust(imu_angle[axis] + delta, 0, 2 * M_PI);
-
-  // ---- Calculate Delta between the new Angle and already feeded IMU Angle ----
-  double dx = adjust(imu_angle[axis] - pimu[axis], -M_PI, M_PI);
-
-  // ---- Feed yaAGC with the new Angular Delta ----
-  double sign = dx > 0 ? +1 : -1;
-  uint16_t n    = floor(fabs(dx) / ANGLE_INCR);
-  pimu[axis] = adjust(pimu[axis] + sign * ANGLE_INCR * n, 0, 2 * M_PI);
-
-  uint16_t cdu = state->erasable[0][26 + axis]; // read CDU counter (26 = 0x32 = CDUX)
+  uint16_t cdu = state->erasable[0][26 + axis]; // read CDU counter
   cdu          = cdu & 0x4000 ? -(cdu ^ 0x7FFF) : cdu; // converts from ones-complement to twos-complement
-  cdu += sign * n; // adds the number of pulses
+  cdu += pulses; // adds the number of pulses
   state->erasable[0][26 + axis] =
     cdu < 0 ? (-cdu) ^ 0x7FFF : cdu; // converts back to ones-complement and writes the counter
+  erasable_written(state, 0, 26 + axis);
+}
+
+// Adds pulses to the PIPA counters (31 = 0x37 = PIPAX) of the erasable memory.
+static void feed_pipa(agc_state_t* state, uint16_t axis, int16_t pulses)
+{
+  int16_t p = state->erasable[0][31 + axis]; // read PIPA counter
+  p     = p & 0x4000 ? -(p ^ 0x7FFF) : p; // converts from ones-complement to twos-complement
+  p += pulses; // adds the number of pulses
+  state->erasable[0][31 + axis] = p < 0 ? (-p) ^ 0x7FFF : p;
+  erasable_written(state, 0, 31 + axis);
+}
+
+void modify_gimbal_angle(agc_state_t* state, flight_t* flight, uint16_t axis, double delta)
+{
+  feed_cdu(state, axis, imu_modify_gimbal(&flight->imu, axis, imu_angle_from_rad(delta)));
 }
 
 int16_t from_int15(uint16_t val) {
   return val & 0x4000 ? -(val & 0x3FFF) : val & 0x3FFF;
 }
 
-void gyro_fine_align(agc_state_t* state, uint16_t chan, uint16_t val)
+void gyro_fine_align(agc_state_t* state, flight_t* flight, uint16_t chan, uint16_t val)
 {
   uint16_t gyro_sign_minus  = val & 0x4000;
   uint16_t gyro_selection_a = val & 0x2000;
@@ -70,81 +71,48 @@ void gyro_fine_align(agc_state_t* state, uint16_t chan, uint16_t val)
 
   if(!gyro_selection_a && gyro_selection_b)
   {
-    modify_gimbal_angle(state, 0, gyro_pulses * FA_ANGLE);
+    modify_gimbal_angle(state, flight, 0, gyro_pulses * FA_ANGLE);
   }
   if(gyro_selection_a && !gyro_selection_b)
   {
-    modify_gimbal_angle(state, 1, gyro_pulses * FA_ANGLE);
+    modify_gimbal_angle(state, flight, 1, gyro_pulses * FA_ANGLE);
   }
   if(gyro_selection_a && gyro_selection_b)
   {
-    modify_gimbal_angle(state, 2, gyro_pulses * FA_ANGLE);
+    modify_gimbal_angle(state, flight, 2, gyro_pulses * FA_ANGLE);
   }
 }
 
-void gyro_coarse_align(agc_state_t* state, uint16_t chan, uint16_t val){
+void gyro_coarse_align(agc_state_t* state, flight_t* flight, uint16_t chan, uint16_t val){
   int16_t cdu_pulses = from_int15(val);
-  modify_gimbal_angle(state, chan - 124, cdu_pulses * CA_ANGLE);
+  modify_gimbal_angle(state, flight, chan - 124, cdu_pulses * CA_ANGLE);
 }
 
-void rotate(agc_state_t* state, double delta[3])
+void rotate(agc_state_t* state, flight_t* flight, double delta[3])
 {
-  // based on Transform_BodyAxes_StableMember {dp dq dr}
-
-  double MPI    = sin(imu_angle[2]);
-  double MQI    = cos(imu_angle[2]) * cos(imu_angle[0]);
-  double MQM    = sin(imu_angle[0]);
-  double MRI    = -cos(imu_angle[2]) * sin(imu_angle[0]);
-  double MRM    = cos(imu_angle[0]);
-  double nenner = MRM * MQI - MRI * MQM;
-
-  //---- Calculate Angular Change ----
-  double do_b = adjust(
-    delta[0] - (delta[1] * MRM * MPI - delta[2] * MQM * MPI) / nenner, -M_PI, M_PI);
-  double di_b = adjust((delta[1] * MRM - delta[2] * MQM) / nenner, -M_PI, M_PI);
-  double dm_b = adjust((delta[2] * MQI - delta[1] * MRI) / nenner, -M_PI, M_PI);
-
-  //--- Rad to Deg and call of Gimbal Angle Modification ----
-  modify_gimbal_angle(state, 0, do_b);
-  modify_gimbal_angle(state, 1, di_b);
-  modify_gimbal_angle(state, 2, dm_b);
+  int64_t angles[3];
+  int16_t cdu[3];
+  for(int axis = 0; axis < 3; axis++)
+    angles[axis] = imu_angle_from_rad(delta[axis]);
+
+  imu_rotate(&flight->imu, angles, cdu);
+  for(int axis = 0; axis < 3; axis++)
+    feed_cdu(state, axis, cdu[axis]);
 }
 
-double velocity[3] = {0};
-int64_t pipa[3]     = {0};
 //************************************************************************************************
 //*** Function: Modify PIPA Values to match simulated Speed                                   ****
 //************************************************************************************************
-void accelerate(agc_state_t* state, double delta[3])
+void accelerate(agc_state_t* state, flight_t* flight, double delta[3])
 {
-  // based on proc modify_pipaXYZ
-  double sinOG = sin(imu_angle[0]);
-  double sinIG = sin(imu_angle[1]);
-  double sinMG = sin(imu_angle[2]);
-  double cosOG = cos(imu_angle[0]);
-  double cosIG = cos(imu_angle[1]);
-  double cosMG = cos(imu_angle[2]);
-
-  double dv[] = {
-    cosMG * cosIG * delta[0] + (-cosOG * sinMG * cosIG + sinOG * sinIG) * delta[1]
-      + (sinOG * sinMG * cosIG + cosOG * sinIG) * delta[2],
-    sinMG * delta[0] + cosOG * cosMG * delta[1] - sinOG * cosMG * delta[2],
-    -cosMG * sinIG * delta[0] + (cosOG * sinMG * sinIG + sinOG * cosIG) * delta[1]
-      + (-sinOG * sinMG * sinIG + cosOG * cosIG) * delta[2]
-  };
-
+  int64_t velocity[3];
+  int16_t pipa[3];
   for(int axis = 0; axis < 3; axis++)
-  {
-    velocity[axis] += dv[axis];
-    int16_t counts = floor((velocity[axis] - pipa[axis] * PIPA_INCR) / PIPA_INCR);
+    velocity[axis] = imu_velocity_from_mps(delta[axis]);
 
-    pipa[axis] += counts;
-
-    int16_t p = state->erasable[0][31 + axis]; // read PIPA counter (31 = 0x37 = PIPAX)
-    p     = p & 0x4000 ? -(p ^ 0x7FFF) : p; // converts from ones-complement to twos-complement
-    p += counts; // adds the number of pulses
-    state->erasable[0][31 + axis] = p < 0 ? (-p) ^ 0x7FFF : p;
-  }
+  imu_accelerate(&flight->imu, velocity, pipa);
+  for(int axis = 0; axis < 3; axis++)
+    feed_pipa(state, axis, pipa[axis]);
 }
 
 
@@ -152,53 +120,50 @@ void accelerate(agc_state_t* state, double delta[3])
 #define ALIGN 1
 #define STARTED 2
 
-uint16_t modestate = INIT;
-
-uint64_t init_time = 0;
-uint64_t start_time = 0;
-uint64_t next_flight_update = 0;
-uint64_t current_time = 0;
-uint64_t real_start_time = 0;
-uint64_t real_current_time = 0;
-
-uint16_t last_time = 0;
+void flight_init(flight_t* flight, profile_t* profile)
+{
+  memset(flight, 0, sizeof(flight_t));
+  flight->profile   = profile;
+  flight->modestate = INIT;
+  imu_init(&flight->imu);
+}
 
-void sim2agc_handle(agc_state_t* state, dsky_t* dsky)
+void sim2agc_handle(agc_state_t* state, dsky_t* dsky, flight_t* flight)
 {
   uint16_t prog_nr = dsky->prog.first * 10 + dsky->prog.second;
 
   if(prog_nr == 1)
   {
-    modestate = INIT;
+    flight->modestate = INIT;
   }else if(prog_nr == 2){
     uint16_t mem_time = state->erasable[0][RegTIME5];
 
-    if(modestate == INIT){
-      modestate = ALIGN;
-      init_time = mem_time;
-    }else if(modestate == ALIGN && mem_time - init_time >= 300){
-      dsky_channel_output(24, 0);
-      modestate = STARTED;
-      start_time = mem_time;
-      next_flight_update = mem_time;
-      last_time = mem_time;
-      current_time = mem_time;
-      real_start_time = current_time_millis();
+    if(flight->modestate == INIT){
+      flight->modestate = ALIGN;
+      flight->init_time = mem_time;
+    }else if(flight->modestate == ALIGN && mem_time - flight->init_time >= 300){
+      dsky_channel_output(state, 24, 0);
+      flight->modestate = STARTED;
+      flight->start_time = mem_time;
+      flight->next_flight_update = mem_time;
+      flight->last_time = mem_time;
+      flight->current_time = mem_time;
+      flight->real_start_time = current_time_millis();
     }
   }else if(prog_nr == 11){
     uint16_t mem_time = state->erasable[0][RegTIME5];
-    uint16_t offset_time = mem_time >= last_time
-            ? mem_time - last_time
-            : 0x3FFF + (mem_time - last_time);
+    uint16_t offset_time = mem_time >= flight->last_time
+            ? mem_time - flight->last_time
+            : 0x3FFF + (mem_time - flight->last_time);
 
-    last_time = mem_time;
-    current_time += offset_time;
-    real_current_time = current_time_millis();
+    flight->last_time = mem_time;
+    flight->current_time += offset_time;
+    flight->real_current_time = current_time_millis();
 
-    while(next_flight_update <= current_time)
+    while(flight->next_flight_update <= flight->current_time)
     {
-      uint64_t flight_time = next_flight_update - start_time;
-      row_t data = profile_get_data(flight_time / 100);
+      uint64_t flight_time = flight->next_flight_update - flight->start_time;
+      row_t data = profile_get_data(flight->profile, flight_time * 10);
       double accel[3] = {
         1.08 * data.accel_x,
         0.0,
@@ -211,51 +176,63 @@ void sim2agc_handle(agc_state_t* state, dsky_t* dsky)
         0.0
       };
 
-      accelerate(state, accel);
-      rotate(state, rot);
-      next_flight_update += 10;
+      accelerate(state, flight, accel);
+      rotate(state, flight, rot);
+      flight->next_flight_update += FLIGHT_STEP_CS;
     }
   }
 
 }
 
-void agc2dsky_handle(agc_state_t* state, dsky_t* dsky)
+void agc2dsky_handle(agc_state_t* state, dsky_t* dsky, flight_t* flight)
 {
-  uint16_t channel;
-  uint16_t value;
-  while(dsky_channel_input(&channel, &value))
+  packet_t packets[32];
+  int      n;
+  int      refresh = 0;
+
+  // Drain the output in bursts and redraw the display once per call rather
+  // than once per digit.
+  while((n = ringbuffer_get_n(&state->ringbuffer_out, packets, 32)) > 0)
   {
-    if(channel == 8 || channel == 9 || channel == 11 || channel == 0163)//010
-    {
-      if(dsky_update_digit(dsky, channel, value))
-        dsky_refresh(dsky);
-    }
-    else if(channel == 124 || channel == 125 || channel == 126)
+    for(int i = 0; i < n; i++)
     {
-      gyro_coarse_align(state, channel, value);
-    }
-    else if(channel == 127)
-    {
-      gyro_fine_align(state, channel, value);
+      uint16_t channel = packets[i].channel;
+      uint16_t value   = packets[i].value;
+
+      if(channel == 8 || channel == 9 || channel == 11 || channel == 0163)//010
+      {
+        refresh |= dsky_update_digit(dsky, channel, value);
+      }
+      else if(channel == 124 || channel == 125 || channel == 126)
+      {
+        gyro_coarse_align(state, flight, channel, value);
+      }
+      else if(channel == 127)
+      {
+        gyro_fine_align(state, flight, channel, value);
+      }
     }
   }
+
+  if(refresh)
+    dsky_refresh(dsky);
 }
 
-void dsky_press_key(Key key)
+void dsky_press_key(agc_state_t* state, Key key)
 {
-  dsky_channel_output(015, key);
+  dsky_channel_output(state, 015, key);
 }
 
-void dsky_press_pro(bool on)
+void dsky_press_pro(agc_state_t* state, bool on)
 {
-  dsky_channel_output(032, on ? 020000 : 0);
+  dsky_channel_output(state, 032, on ? 020000 : 0);
 }
 
 
-int dsky_channel_input(uint16_t* channel, uint16_t* value)
+int dsky_channel_input(agc_state_t* state, uint16_t* channel, uint16_t* value)
 {
   packet_t packet;
-  if(!ringbuffer_get(&ringbuffer_out, (unsigned char*)&packet))
+  if(!ringbuffer_get(&state->ringbuffer_out, &packet))
     return 0;
 
   *channel = packet.channel;
@@ -263,11 +240,11 @@ int dsky_channel_input(uint16_t* channel, uint16_t* value)
   return 1;
 }
 
-int dsky_channel_output(uint16_t channel, uint16_t value)
+int dsky_channel_output(agc_state_t* state, uint16_t channel, uint16_t value)
 {
   packet_t packet = {.channel = channel, .value = value};
 
-  return ringbuffer_put(&ringbuffer_in, (unsigned char*)&packet);
+  return ringbuffer_put(&state->ringbuffer_in, &packet);
 }
 
 int map[] = {15, 15, 15, 1,  15, 15, 15, 15, 15, 15, 15,
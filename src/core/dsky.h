@@ -4,6 +4,8 @@
 #include <stdint.h>
 
 #include "agc_engine.h"
+#include "imu.h"
+#include "profile.h"
 
 typedef enum
 {
@@ -86,13 +88,33 @@ typedef struct
   bool blink_off;
 } dsky_t;
 
-void sim2agc_handle(agc_state_t* state, dsky_t* dsky);
-void agc2dsky_handle(agc_state_t* state, dsky_t* dsky);
-void serial2agc_handle();
-void dsky2agc_handle();
-
-void dsky_press_key(Key key);
-void dsky_press_pro(bool on);
+typedef struct
+{
+  profile_t* profile;
+  imu_t    imu;
+  uint16_t modestate;
+  uint64_t init_time;
+  uint64_t start_time;
+  uint64_t next_flight_update;
+  uint64_t current_time;
+  uint64_t real_start_time;
+  uint64_t real_current_time;
+  uint16_t last_time;
+} flight_t;
+
+void flight_init(flight_t* flight, profile_t* profile);
+
+void sim2agc_handle(agc_state_t* state, dsky_t* dsky, flight_t* flight);
+void agc2dsky_handle(agc_state_t* state, dsky_t* dsky, flight_t* flight);
+// The front ends' key handlers pass key presses on to the AGC and return
+// what else the operator asked of the simulator.
+#define DSKY_REQUEST_REWIND 0x0001 // Go back by SIM_REWIND_US.
+
+int serial2agc_handle(agc_state_t* state);
+int dsky2agc_handle(agc_state_t* state);
+
+void dsky_press_key(agc_state_t* state, Key key);
+void dsky_press_pro(agc_state_t* state, bool on);
 
 void dsky_row_init(dsky_row_t* row);
 
@@ -108,5 +130,5 @@ void dsky_two_print(dsky_two_t* two);
 
 void dsky_refresh(dsky_t* dsky);
 
-int  dsky_channel_input(uint16_t* channel, uint16_t* value);
-int  dsky_channel_output(uint16_t channel, uint16_t value);
+int  dsky_channel_input(agc_state_t* state, uint16_t* channel, uint16_t* value);
+int  dsky_channel_output(agc_state_t* state, uint16_t channel, uint16_t value);
@@ -19,9 +19,10 @@ char digit2char(unsigned int digit)
   return '0' + digit;
 }
 
-void dsky_row_print(dsky_row_t* row)
+static void dsky_row_fprint(FILE* out, dsky_row_t* row)
 {
-  printf(
+  fprintf(
+    out,
     "%c%c%c%c%c%c\n",
     row->minus    ? '-'
       : row->plus ? '+'
@@ -33,24 +34,39 @@ void dsky_row_print(dsky_row_t* row)
     digit2char(row->fifth));
 }
 
+static void dsky_two_fprint(FILE* out, dsky_two_t* two)
+{
+  fprintf(out, "%c%c", digit2char(two->first), digit2char(two->second));
+}
+
+void dsky_row_print(dsky_row_t* row)
+{
+  dsky_row_fprint(stdout, row);
+}
+
 void dsky_two_print(dsky_two_t* two)
 {
-  printf("%c%c", digit2char(two->first), digit2char(two->second));
+  dsky_two_fprint(stdout, two);
+}
+
+void dsky_fprint(FILE* out, dsky_t* dsky)
+{
+  fprintf(out, "CA  PR\n");
+  fprintf(out, "%s", dsky->indicator.comp_acty ? "XX" : "  ");
+  fprintf(out, "  ");
+  dsky_two_fprint(out, &dsky->prog);
+  fprintf(out, "\n");
+  fprintf(out, "VB  NO\n");
+  dsky_two_fprint(out, &dsky->verb);
+  fprintf(out, "  ");
+  dsky_two_fprint(out, &dsky->noun);
+  fprintf(out, "\n");
+  dsky_row_fprint(out, &dsky->rows[0]);
+  dsky_row_fprint(out, &dsky->rows[1]);
+  dsky_row_fprint(out, &dsky->rows[2]);
 }
 
 void dsky_print(dsky_t* dsky)
 {
-  printf("CA  PR\n");
-  printf("%s", dsky->indicator.comp_acty ? "XX" : "  ");
-  printf("  ");
-  dsky_two_print(&dsky->prog);
-  printf("\n");
-  printf("VB  NO\n");
-  dsky_two_print(&dsky->verb);
-  printf("  ");
-  dsky_two_print(&dsky->noun);
-  printf("\n");
-  dsky_row_print(&dsky->rows[0]);
-  dsky_row_print(&dsky->rows[1]);
-  dsky_row_print(&dsky->rows[2]);
+  dsky_fprint(stdout, dsky);
 }
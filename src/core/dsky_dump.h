@@ -2,5 +2,8 @@
 
 #include "core/dsky.h"
 
+#include <stdio.h>
+
 
 void dsky_print(dsky_t* dsky);
+void dsky_fprint(FILE* out, dsky_t* dsky);
@@ -0,0 +1,261 @@
+#include "history.h"
+
+#include <string.h>
+
+// A new keyframe is taken once the deltas since the last one fill this share
+// of the buffer, so making room never drops more than about a third of the
+// history at once.
+#define HISTORY_GENERATION 3
+
+// Bytes of the block bitmap of a body of size bytes.
+#define HISTORY_MAP(size) (((size) + HISTORY_BLOCK * 8 - 1) / (HISTORY_BLOCK * 8))
+
+typedef struct
+{
+  uint8_t* data;
+  uint32_t len;
+  uint32_t size;
+} memory_writer_t;
+
+static bool memory_write(void* context, const void* data, uint32_t len)
+{
+  memory_writer_t* w = context;
+  if(len > w->size - w->len)
+    return false;
+  memcpy(w->data + w->len, data, len);
+  w->len += len;
+  return true;
+}
+
+// The i-th frame from the oldest.
+static history_frame_t* history_frame(history_t* history, uint32_t i)
+{
+  return &history->frames[(history->first + i) % HISTORY_FRAMES];
+}
+
+static uint32_t history_index(const history_t* history, uint32_t i)
+{
+  return (history->first + i) % HISTORY_FRAMES;
+}
+
+void history_init(history_t* history, uint8_t* buffer, uint32_t size)
+{
+  history->buffer         = buffer;
+  history->size           = size;
+  history->first          = 0;
+  history->count          = 0;
+  history->keyframe       = -1;
+  history->since_keyframe = 0;
+  history->dirty          = ~0ull;
+}
+
+// Drops the oldest frame, which is always a keyframe, and its deltas.
+static void history_drop(history_t* history)
+{
+  do
+  {
+    if((int32_t)history->first == history->keyframe)
+      history->keyframe = -1;
+    history->first = (history->first + 1) % HISTORY_FRAMES;
+    history->count--;
+  } while(history->count && !history_frame(history, 0)->keyframe);
+}
+
+// Finds room for len bytes after the newest record, wrapping round to the
+// start of the buffer, and drops the oldest frames that are in the way.
+// Fails if len does not fit, or if keep is set and the newest keyframe would
+// have to go.
+static bool history_alloc(history_t* history, uint32_t len, bool keep, uint32_t* offset)
+{
+  if(len > history->size)
+    return false;
+
+  *offset = 0;
+  if(history->count)
+  {
+    const history_frame_t* newest = history_frame(history, history->count - 1);
+    *offset = newest->offset + newest->size;
+    if(*offset + len > history->size)
+      *offset = 0;
+  }
+
+  while(history->count)
+  {
+    const history_frame_t* oldest = history_frame(history, 0);
+    if(oldest->offset >= *offset + len || *offset >= oldest->offset + oldest->size)
+      break;
+    if(keep && (int32_t)history->first == history->keyframe)
+      return false;
+    history_drop(history);
+  }
+  return true;
+}
+
+// Marks the blocks of body that differ from the newest keyframe's in map and
+// returns the size of the delta record. Blocks of erasable pages that have
+// not been written since the keyframe are known to be the same.
+static uint32_t history_diff(const history_t* history, const uint8_t* body, uint32_t body_size, uint8_t* map)
+{
+  const history_frame_t* key       = &history->frames[history->keyframe];
+  const uint8_t*         base      = history->buffer + key->offset + sizeof(snapshot_header_t);
+  uint32_t               base_size = key->size - sizeof(snapshot_header_t);
+
+  uint32_t size = sizeof(snapshot_header_t) + HISTORY_MAP(body_size);
+  for(uint32_t start = 0; start < body_size; start += HISTORY_BLOCK)
+  {
+    uint32_t len  = body_size - start < HISTORY_BLOCK ? body_size - start : HISTORY_BLOCK;
+    uint32_t page = start / (AGC_PAGE_WORDS * 2);
+    if(page < AGC_PAGES && !(history->dirty & 1ull << page))
+      continue;
+    if(start + len <= base_size && !memcmp(body + start, base + start, len))
+      continue;
+    map[start / HISTORY_BLOCK / 8] |= 1 << (start / HISTORY_BLOCK % 8);
+    size += len;
+  }
+  return size;
+}
+
+bool history_record(history_t* history, agc_state_t* state, const dsky_t* dsky, const flight_t* flight)
+{
+  history->dirty |= agc_take_dirty_pages(state);
+  memory_writer_t w = {.data = history->scratch, .size = sizeof(history->scratch)};
+  if(!snapshot_save(state, dsky, flight, memory_write, &w))
+    return false;
+  if(history->count == HISTORY_FRAMES)
+    history_drop(history);
+
+  const uint8_t* body      = history->scratch + sizeof(snapshot_header_t);
+  uint32_t       body_size = w.len - sizeof(snapshot_header_t);
+
+  uint8_t  map[HISTORY_BLOCKS / 8] = {0};
+  uint32_t size                    = w.len;
+  bool     keyframe                = history->keyframe < 0 ||
+                    history->since_keyframe >= history->size / HISTORY_GENERATION;
+  if(!keyframe)
+  {
+    size     = history_diff(history, body, body_size, map);
+    keyframe = size >= w.len / 2;
+    if(keyframe)
+      size = w.len;
+  }
+
+  uint32_t offset;
+  if(!history_alloc(history, size, !keyframe, &offset))
+  {
+    // The delta would overwrite its own keyframe.
+    if(keyframe || !history_alloc(history, w.len, false, &offset))
+      return false;
+    keyframe = true;
+    size     = w.len;
+  }
+
+  uint8_t* record = history->buffer + offset;
+  if(keyframe)
+    memcpy(record, history->scratch, w.len);
+  else
+  {
+    memcpy(record, history->scratch, sizeof(snapshot_header_t));
+    record += sizeof(snapshot_header_t);
+    memcpy(record, map, HISTORY_MAP(body_size));
+    record += HISTORY_MAP(body_size);
+    for(uint32_t start = 0; start < body_size; start += HISTORY_BLOCK)
+    {
+      uint32_t len = body_size - start < HISTORY_BLOCK ? body_size - start : HISTORY_BLOCK;
+      if(!(map[start / HISTORY_BLOCK / 8] & 1 << (start / HISTORY_BLOCK % 8)))
+        continue;
+      memcpy(record, body + start, len);
+      record += len;
+    }
+  }
+
+  uint32_t         index = history_index(history, history->count);
+  history_frame_t* frame = &history->frames[index];
+  frame->cycle_counter   = state->cycle_counter;
+  frame->offset          = offset;
+  frame->size            = size;
+  frame->keyframe        = keyframe;
+  history->count++;
+  if(keyframe)
+  {
+    history->keyframe       = index;
+    history->since_keyframe = 0;
+    history->dirty          = 0;
+  }
+  else
+    history->since_keyframe += size;
+  return true;
+}
+
+// Rebuilds the snapshot of a frame in scratch from its record and that of
+// its keyframe, and returns its size.
+static uint32_t history_expand(history_t* history, const history_frame_t* frame, const history_frame_t* key)
+{
+  const uint8_t* record = history->buffer + frame->offset;
+  if(frame->keyframe)
+  {
+    memcpy(history->scratch, record, frame->size);
+    return frame->size;
+  }
+
+  snapshot_header_t header;
+  memcpy(&header, record, sizeof(header));
+  memcpy(history->scratch, record, sizeof(header));
+  const uint8_t* map    = record + sizeof(header);
+  const uint8_t* blocks = map + HISTORY_MAP(header.size);
+
+  uint8_t*       body      = history->scratch + sizeof(header);
+  const uint8_t* base      = history->buffer + key->offset + sizeof(header);
+  uint32_t       base_size = key->size - sizeof(header);
+  memcpy(body, base, base_size < header.size ? base_size : header.size);
+  for(uint32_t start = 0; start < header.size; start += HISTORY_BLOCK)
+  {
+    uint32_t len = header.size - start < HISTORY_BLOCK ? header.size - start : HISTORY_BLOCK;
+    if(!(map[start / HISTORY_BLOCK / 8] & 1 << (start / HISTORY_BLOCK % 8)))
+      continue;
+    memcpy(body + start, blocks, len);
+    blocks += len;
+  }
+  return sizeof(header) + header.size;
+}
+
+int history_rewind(history_t* history, uint64_t cycle_counter, agc_state_t* state, dsky_t* dsky, flight_t* flight)
+{
+  if(!history->count)
+    return SNAPSHOT_E_FORMAT;
+
+  uint32_t i = history->count - 1;
+  while(i > 0 && history_frame(history, i)->cycle_counter > cycle_counter)
+    i--;
+  uint32_t key = i;
+  while(!history_frame(history, key)->keyframe)
+    key--;
+
+  uint32_t len   = history_expand(history, history_frame(history, i), history_frame(history, key));
+  int      error = snapshot_load(state, dsky, flight, history->scratch, len);
+  if(error)
+    return error;
+
+  history->count          = i + 1;
+  history->keyframe       = history_index(history, key);
+  history->since_keyframe = 0;
+  history->dirty          = ~0ull;
+  for(uint32_t j = key + 1; j <= i; j++)
+    history->since_keyframe += history_frame(history, j)->size;
+  return SNAPSHOT_E_OK;
+}
+
+uint32_t history_used(const history_t* history)
+{
+  uint32_t used = 0;
+  for(uint32_t i = 0; i < history->count; i++)
+    used += history->frames[history_index(history, i)].size;
+  return used;
+}
+
+uint64_t history_span(const history_t* history)
+{
+  if(!history->count)
+    return 0;
+  return history->frames[history_index(history, history->count - 1)].cycle_counter -
+         history->frames[history->first].cycle_counter;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+
+#include <stdint.h>
+
+#include "agc_engine.h"
+#include "dsky.h"
+#include "snapshot.h"
+
+// Recent history of a running machine, kept so that a session can be rewound
+// by a few seconds. Every frame is a snapshot, either in full (a keyframe) or
+// as a delta against the newest keyframe: the snapshot header, a bitmap of
+// the HISTORY_BLOCK byte blocks of the body that differ from the keyframe's,
+// and those blocks. The body is erasable memory, then the input channels,
+// then the registers, DSKY and flight model in a few hundred bytes, so a
+// delta is mostly the erasable words and channels written since the
+// keyframe. Only the erasable pages the machine marked as written since the
+// keyframe, see erasable_written(), are compared with it.
+//
+// Frames are kept in a ring of records in a buffer the front end provides;
+// the oldest keyframe is dropped together with its deltas to make room.
+#define HISTORY_FRAMES 128
+#define HISTORY_BLOCK  16
+#define HISTORY_BODY   8192 // Largest snapshot body that is kept.
+#define HISTORY_BLOCKS (HISTORY_BODY / HISTORY_BLOCK)
+
+typedef struct
+{
+  uint64_t cycle_counter; // Of the machine when the frame was taken.
+  uint32_t offset;        // Of the record in the buffer.
+  uint32_t size;          // Of the record.
+  bool     keyframe;
+} history_frame_t;
+
+typedef struct
+{
+  uint8_t*        buffer;
+  uint32_t        size;
+  history_frame_t frames[HISTORY_FRAMES]; // Ring, oldest at first.
+  uint32_t        first;
+  uint32_t        count;
+  int32_t         keyframe;      // Ring index of the newest keyframe, -1 if none.
+  uint32_t        since_keyframe; // Bytes recorded since the newest keyframe.
+  uint64_t        dirty;          // Erasable pages written since the newest keyframe.
+  uint8_t         scratch[sizeof(snapshot_header_t) + HISTORY_BODY];
+} history_t;
+
+void history_init(history_t* history, uint8_t* buffer, uint32_t size);
+
+// Adds a frame of the machine and, unless they are NULL, the DSKY and the
+// flight model. Returns false if it does not fit in the buffer at all.
+// Takes the pages of erasable memory written from state, so it must be the
+// only caller of agc_take_dirty_pages() on the machine.
+bool history_record(history_t* history, agc_state_t* state, const dsky_t* dsky, const flight_t* flight);
+
+// Restores the newest frame taken at or before cycle_counter, or the oldest
+// one if all are newer, and forgets the frames after it, so rewinding again
+// goes further back. Returns the error of snapshot_load(), SNAPSHOT_E_FORMAT
+// if there is no frame.
+int history_rewind(history_t* history, uint64_t cycle_counter, agc_state_t* state, dsky_t* dsky, flight_t* flight);
+
+// Bytes of the buffer in use and the AGC time the frames span, for reports.
+uint32_t history_used(const history_t* history);
+uint64_t history_span(const history_t* history);
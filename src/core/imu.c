@@ -0,0 +1,320 @@
+#include "imu.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Trigonometric values are Q62. sin() is tabulated at IMU_SIN_ENTRIES points
+// of the circle; in between, the table is corrected with the angle addition
+// formula and Taylor series of the remainder, which is below
+// 2 pi / IMU_SIN_ENTRIES. It is only needed when the gimbal angles are set
+// directly; the flight steps work on the quaternion.
+#define IMU_Q           62
+#define IMU_ONE         ((int64_t)1 << IMU_Q)
+#define IMU_HALF_PI     INT64_C(7244019458077122842) // pi / 2 in Q62
+#define IMU_HALF_TURN   ((uint64_t)1 << 63)
+#define IMU_SIN_BITS    9
+#define IMU_SIN_ENTRIES (1 << IMU_SIN_BITS)
+#define IMU_FRAC_BITS   (64 - IMU_SIN_BITS)
+
+// Gimbal angles are recovered from the matrix with CORDIC, in Q29 so the
+// gain of the iterations cannot overflow.
+#define IMU_CORDIC_Q     29
+#define IMU_CORDIC_STEPS 8
+
+// Below this cos(middle gimbal), in Q62, the inner gimbal angle cannot be
+// read off to a CDU pulse any more.
+#define IMU_LOCK (IMU_ONE >> 16)
+
+static int64_t  imu_sin_table[IMU_SIN_ENTRIES];
+static uint32_t imu_atan_table[IMU_CORDIC_STEPS];
+static int64_t  imu_cordic_gain; // about 1.64676, Q62
+static bool     imu_tables_ready = false;
+
+// (a * b) >> shift, rounded, with a 128 bit intermediate product.
+static int64_t imu_mul(int64_t a, int64_t b, int shift)
+{
+#ifdef __SIZEOF_INT128__
+  __int128 p = (__int128)a * b;
+  return (int64_t)((p + ((__int128)1 << (shift - 1))) >> shift);
+#else
+  // Cortex-M has no 128 bit type: form the product from 32 bit halves.
+  bool     negative = (a < 0) != (b < 0);
+  uint64_t ua       = a < 0 ? -(uint64_t)a : (uint64_t)a;
+  uint64_t ub       = b < 0 ? -(uint64_t)b : (uint64_t)b;
+
+  uint64_t ll  = (ua & 0xffffffff) * (ub & 0xffffffff);
+  uint64_t lh  = (ua & 0xffffffff) * (ub >> 32);
+  uint64_t hl  = (ua >> 32) * (ub & 0xffffffff);
+  uint64_t hh  = (ua >> 32) * (ub >> 32);
+  uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+  uint64_t lo  = (mid << 32) | (ll & 0xffffffff);
+  uint64_t hi  = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+  if(negative)
+  {
+    lo = -lo;
+    hi = ~hi + (lo == 0);
+  }
+
+  // Add half an LSB and shift the 128 bit value arithmetically.
+  uint64_t half = (uint64_t)1 << (shift - 1);
+  lo += half;
+  hi += lo < half;
+  return (int64_t)((hi << (64 - shift)) | (lo >> shift));
+#endif
+}
+
+static void imu_sincos(uint64_t angle, int64_t* s, int64_t* c)
+{
+  uint32_t idx  = angle >> IMU_FRAC_BITS;
+  int64_t  frac = angle & (((uint64_t)1 << IMU_FRAC_BITS) - 1);
+
+  // Remainder in Q62 radians: frac * 2 pi / 2^64 * 2^62 = frac * pi / 2.
+  int64_t d  = imu_mul(frac, IMU_HALF_PI, IMU_Q);
+  int64_t d2 = imu_mul(d, d, IMU_Q);
+  int64_t d4 = imu_mul(d2, d2, IMU_Q);
+  int64_t d6 = imu_mul(d4, d2, IMU_Q);
+  int64_t sd = d - imu_mul(d, d2 / 6 - d4 / 120 + d6 / 5040, IMU_Q);
+  int64_t cd = IMU_ONE - d2 / 2 + d4 / 24 - d6 / 720;
+
+  int64_t st = imu_sin_table[idx];
+  int64_t ct = imu_sin_table[(idx + IMU_SIN_ENTRIES / 4) & (IMU_SIN_ENTRIES - 1)];
+
+  *s = imu_mul(st, cd, IMU_Q) + imu_mul(ct, sd, IMU_Q);
+  *c = imu_mul(ct, cd, IMU_Q) - imu_mul(st, sd, IMU_Q);
+}
+
+// Angle of the vector (x, y) as a binary angle; the length of the vector,
+// times imu_cordic_gain, is left in *length. The attitude itself stays in
+// the quaternion, so the angles only need to resolve a CDU pulse and the
+// CORDIC rotations run on 32 bits. They bring the angle below 2^-7 rad,
+// where the series of atan() in single precision finishes it.
+static uint64_t imu_atan2(int64_t y64, int64_t x64, int32_t* length)
+{
+  int32_t  x = (int32_t)(x64 >> (IMU_Q - IMU_CORDIC_Q));
+  int32_t  y = (int32_t)(y64 >> (IMU_Q - IMU_CORDIC_Q));
+  uint32_t z = 0;
+
+  if(x < 0)
+  {
+    x = -x;
+    y = -y;
+    z = (uint32_t)1 << 31;
+  }
+
+  for(int i = 0; i < IMU_CORDIC_STEPS; i++)
+  {
+    // rotate towards the x axis, branch free: m is 0 or -1
+    int32_t dx = y >> i;
+    int32_t dy = x >> i;
+    int32_t m  = -(int32_t)(y < 0);
+    x += (dx ^ m) - m;
+    y -= (dy ^ m) - m;
+    z += (imu_atan_table[i] ^ (uint32_t)m) - (uint32_t)m;
+  }
+  if(x)
+  {
+    float t  = (float)y / (float)x;
+    float t2 = t * t;
+    z += (int32_t)(t * (1.0f - t2 * (1.0f / 3 - t2 * (1.0f / 5))) * (float)(2147483648.0 / M_PI));
+  }
+
+  if(length)
+    *length = x;
+  return (uint64_t)z << 32;
+}
+
+// How far apart two sets of gimbal angles are, for picking between the two
+// that describe an attitude.
+static uint64_t imu_distance(const uint64_t a[3], const uint64_t b[3])
+{
+  uint64_t distance = 0;
+  for(int axis = 0; axis < 3; axis++)
+  {
+    int64_t d = (int64_t)(a[axis] - b[axis]);
+    distance += (d < 0 ? -(uint64_t)d : (uint64_t)d) >> 2;
+  }
+  return distance;
+}
+
+// Rebuilds the matrix from the quaternion and reads the gimbal angles off
+// it. The gimbals turn the stable member into the body as
+// Ry(inner) Rz(middle) Rx(outer). Every attitude has two sets of angles,
+// (outer, inner, middle) and (outer + 180, inner + 180, 180 - middle), and
+// the one closer to the previous angles is taken, so the gimbals turn on
+// through +-90 degrees of middle gimbal instead of flipping over. At gimbal
+// lock the outer and inner gimbals turn about the same axis and only a
+// combination of the two is known: the inner gimbal is then left where it
+// was and the outer one takes up the rest.
+static void imu_update(imu_t* imu)
+{
+  // The diagonal is w^2 + x^2 - y^2 - z^2 and so on rather than 1 - 2 (y^2 +
+  // z^2): 2 y^2 does not fit Q62 at a half turn.
+  int64_t w = imu->q[0], x = imu->q[1], y = imu->q[2], z = imu->q[3];
+  int64_t ww = imu_mul(w, w, IMU_Q), xx = imu_mul(x, x, IMU_Q);
+  int64_t yy = imu_mul(y, y, IMU_Q), zz = imu_mul(z, z, IMU_Q);
+  int64_t xy = imu_mul(x, y, IMU_Q - 1), xz = imu_mul(x, z, IMU_Q - 1), yz = imu_mul(y, z, IMU_Q - 1);
+  int64_t wx = imu_mul(w, x, IMU_Q - 1), wy = imu_mul(w, y, IMU_Q - 1), wz = imu_mul(w, z, IMU_Q - 1);
+
+  imu->m[0][0] = ww + xx - yy - zz;
+  imu->m[0][1] = xy - wz;
+  imu->m[0][2] = xz + wy;
+  imu->m[1][0] = xy + wz;
+  imu->m[1][1] = ww - xx + yy - zz;
+  imu->m[1][2] = yz - wx;
+  imu->m[2][0] = xz - wy;
+  imu->m[2][1] = yz + wx;
+  imu->m[2][2] = ww - xx - yy + zz;
+
+  uint64_t angle[3];
+  int64_t  m00 = imu->m[0][0], m20 = imu->m[2][0];
+  if(m00 > -IMU_LOCK && m00 < IMU_LOCK && m20 > -IMU_LOCK && m20 < IMU_LOCK)
+  {
+    // Rz(middle) Rx(outer) = Ry(-inner) M with the inner angle kept; its
+    // last row is (0, sin(outer), cos(outer)).
+    int64_t si, ci;
+    imu_sincos(imu->angle[1], &si, &ci);
+    angle[1] = imu->angle[1];
+    angle[2] = imu_atan2(imu->m[1][0], imu_mul(ci, m00, IMU_Q) - imu_mul(si, m20, IMU_Q), NULL);
+    angle[0] = imu_atan2(imu_mul(si, imu->m[0][1], IMU_Q) + imu_mul(ci, imu->m[2][1], IMU_Q),
+      imu_mul(si, imu->m[0][2], IMU_Q) + imu_mul(ci, imu->m[2][2], IMU_Q), NULL);
+  }
+  else
+  {
+    int32_t cos_mg;
+    angle[1] = imu_atan2(-m20, m00, &cos_mg);
+    angle[2] = imu_atan2(
+      imu_mul(imu->m[1][0], imu_cordic_gain, IMU_Q), (int64_t)cos_mg << (IMU_Q - IMU_CORDIC_Q), NULL);
+    angle[0] = imu_atan2(-imu->m[1][2], imu->m[1][1], NULL);
+
+    uint64_t flipped[3] = {angle[0] + IMU_HALF_TURN, angle[1] + IMU_HALF_TURN, IMU_HALF_TURN - angle[2]};
+    if(imu_distance(flipped, imu->angle) < imu_distance(angle, imu->angle))
+      memcpy(angle, flipped, sizeof(angle));
+  }
+  memcpy(imu->angle, angle, sizeof(angle));
+}
+
+// Sets the quaternion from the gimbal angles, for when they are driven
+// directly rather than by body rotation.
+static void imu_set_angles(imu_t* imu)
+{
+  int64_t so, co, si, ci, sm, cm;
+  imu_sincos(imu->angle[0] >> 1, &so, &co);
+  imu_sincos(imu->angle[1] >> 1, &si, &ci);
+  imu_sincos(imu->angle[2] >> 1, &sm, &cm);
+
+  // q = qy(inner) qz(middle) qx(outer) with the half angles above
+  int64_t cicm = imu_mul(ci, cm, IMU_Q), sism = imu_mul(si, sm, IMU_Q);
+  int64_t sicm = imu_mul(si, cm, IMU_Q), cism = imu_mul(ci, sm, IMU_Q);
+  imu->q[0] = imu_mul(cicm, co, IMU_Q) - imu_mul(sism, so, IMU_Q);
+  imu->q[1] = imu_mul(cicm, so, IMU_Q) + imu_mul(sism, co, IMU_Q);
+  imu->q[2] = imu_mul(sicm, co, IMU_Q) + imu_mul(cism, so, IMU_Q);
+  imu->q[3] = imu_mul(cism, co, IMU_Q) - imu_mul(sicm, so, IMU_Q);
+
+  uint64_t angle[3] = {imu->angle[0], imu->angle[1], imu->angle[2]};
+  imu_update(imu);
+  for(int axis = 0; axis < 3; axis++)
+    imu->angle[axis] = angle[axis];
+}
+
+// Whole CDU pulses between the gimbal angle and the part of it already fed.
+static int16_t imu_feed(imu_t* imu, int axis)
+{
+  int64_t  dx = (int64_t)(imu->angle[axis] - imu->fed[axis]);
+  uint64_t n  = (dx < 0 ? -(uint64_t)dx : (uint64_t)dx) >> IMU_CDU_SHIFT;
+
+  int16_t pulses = dx > 0 ? (int16_t)n : -(int16_t)n;
+  imu->fed[axis] += (uint64_t)(int64_t)pulses << IMU_CDU_SHIFT;
+  return pulses;
+}
+
+void imu_init(imu_t* imu)
+{
+  memset(imu, 0, sizeof(imu_t));
+
+  if(!imu_tables_ready)
+  {
+    for(int i = 0; i < IMU_SIN_ENTRIES; i++)
+      imu_sin_table[i] = llround(ldexp(sin(2 * M_PI * i / IMU_SIN_ENTRIES), IMU_Q));
+    double gain = 1;
+    for(int i = 0; i < IMU_CORDIC_STEPS; i++)
+    {
+      imu_atan_table[i] = (uint32_t)lround(ldexp(atan(ldexp(1, -i)) / M_PI, 31));
+      gain *= sqrt(1 + ldexp(1, -2 * i));
+    }
+    imu_cordic_gain = llround(ldexp(gain, IMU_Q));
+    imu_tables_ready = true;
+  }
+
+  imu->q[0] = IMU_ONE;
+  imu_update(imu);
+}
+
+int64_t imu_angle_from_rad(double rad)
+{
+  return llround(ldexp(rad / M_PI, 63));
+}
+
+int64_t imu_velocity_from_mps(double mps)
+{
+  return llround(ldexp(mps / IMU_PIPA_INCR, IMU_PIPA_SHIFT));
+}
+
+int16_t imu_modify_gimbal(imu_t* imu, int axis, int64_t delta)
+{
+  imu->angle[axis] += (uint64_t)delta;
+  imu_set_angles(imu);
+  return imu_feed(imu, axis);
+}
+
+void imu_rotate(imu_t* imu, const int64_t delta[3], int16_t cdu[3])
+{
+  // Rotation vector of the step in Q62 radians, turned into a quaternion
+  // with the series of cos(t / 2) and sin(t / 2) / t.
+  int64_t r[3];
+  for(int axis = 0; axis < 3; axis++)
+    r[axis] = imu_mul(delta[axis], IMU_HALF_PI, IMU_Q);
+
+  int64_t t2 = imu_mul(r[0], r[0], IMU_Q) + imu_mul(r[1], r[1], IMU_Q) + imu_mul(r[2], r[2], IMU_Q);
+  int64_t t4 = imu_mul(t2, t2, IMU_Q);
+  int64_t dw = IMU_ONE - t2 / 8 + t4 / 384;
+  int64_t dv = IMU_ONE / 2 - t2 / 48 + t4 / 3840;
+  int64_t dx = imu_mul(r[0], dv, IMU_Q), dy = imu_mul(r[1], dv, IMU_Q), dz = imu_mul(r[2], dv, IMU_Q);
+
+  // The step is a rotation in body axes, so it applies on the right.
+  int64_t w = imu->q[0], x = imu->q[1], y = imu->q[2], z = imu->q[3];
+  int64_t q[4] = {
+    imu_mul(w, dw, IMU_Q) - imu_mul(x, dx, IMU_Q) - imu_mul(y, dy, IMU_Q) - imu_mul(z, dz, IMU_Q),
+    imu_mul(w, dx, IMU_Q) + imu_mul(x, dw, IMU_Q) + imu_mul(y, dz, IMU_Q) - imu_mul(z, dy, IMU_Q),
+    imu_mul(w, dy, IMU_Q) - imu_mul(x, dz, IMU_Q) + imu_mul(y, dw, IMU_Q) + imu_mul(z, dx, IMU_Q),
+    imu_mul(w, dz, IMU_Q) + imu_mul(x, dy, IMU_Q) - imu_mul(y, dx, IMU_Q) + imu_mul(z, dw, IMU_Q)
+  };
+
+  // One Newton step back to unit length keeps rounding from accumulating.
+  int64_t n2 = 0;
+  for(int i = 0; i < 4; i++)
+    n2 += imu_mul(q[i], q[i], IMU_Q);
+  int64_t scale = IMU_ONE + (IMU_ONE - n2) / 2;
+  for(int i = 0; i < 4; i++)
+    imu->q[i] = imu_mul(q[i], scale, IMU_Q);
+
+  imu_update(imu);
+  for(int axis = 0; axis < 3; axis++)
+    cdu[axis] = imu_feed(imu, axis);
+}
+
+void imu_accelerate(imu_t* imu, const int64_t delta[3], int16_t pipa[3])
+{
+  // body to stable member, as proc modify_pipaXYZ did from the gimbal angles
+  for(int axis = 0; axis < 3; axis++)
+  {
+    const int64_t* m = imu->m[axis];
+    imu->velocity[axis] +=
+      imu_mul(m[0], delta[0], IMU_Q) + imu_mul(m[1], delta[1], IMU_Q) + imu_mul(m[2], delta[2], IMU_Q);
+
+    int64_t counts = (imu->velocity[axis] >> IMU_PIPA_SHIFT) - imu->pipa[axis];
+    imu->pipa[axis] += counts;
+    pipa[axis] = (int16_t)counts;
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+// Fixed point model of the IMU gimbals and PIPAs driven by the flight
+// simulation. The attitude of the body relative to the stable member is a
+// unit quaternion (Q62) that body rotations are applied to directly; the
+// gimbal angles are derived from it only to feed the CDUs. Angles are 64 bit
+// binary angles (2^64 = one turn), so wrapping is free and a CDU pulse
+// (2^-15 turn) is exactly 1 << IMU_CDU_SHIFT. Velocities are counted in PIPA
+// pulses with IMU_PIPA_SHIFT fraction bits. Every call returns the pulses the
+// AGC counters have to be moved by.
+
+#define IMU_CDU_SHIFT  49
+#define IMU_PIPA_SHIFT 40
+
+#define IMU_PIPA_INCR (0.0585) // m/s per each PIPA pulse
+
+typedef struct
+{
+  int64_t  q[4];        // body to stable member, w x y z
+  int64_t  m[3][3];     // the same rotation as a matrix
+  uint64_t angle[3];    // outer, inner, middle gimbal
+  uint64_t fed[3];      // part of angle already sent to the CDUs
+  int64_t  velocity[3]; // stable member velocity
+  int64_t  pipa[3];     // whole pulses already sent to the PIPAs
+} imu_t;
+
+void imu_init(imu_t* imu);
+
+int64_t imu_angle_from_rad(double rad);
+int64_t imu_velocity_from_mps(double mps);
+
+int16_t imu_modify_gimbal(imu_t* imu, int axis, int64_t delta);
+void    imu_rotate(imu_t* imu, const int64_t delta[3], int16_t cdu[3]);
+void    imu_accelerate(imu_t* imu, const int64_t delta[3], int16_t pipa[3]);
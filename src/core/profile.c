@@ -1,770 +1,119 @@
-
 #include "profile.h"
 
-#include <cjson/cJSON.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-row_t rows[704];
+static bool profile_check(const profile_header_t* header)
+{
+  return header->magic == PROFILE_MAGIC && header->version == PROFILE_VERSION &&
+         header->sample_size == sizeof(profile_sample_t) && header->step_ms != 0;
+}
 
-row_t profile_get_data(int seconds)
+// Returns count consecutive samples from idx on, refilling the window of a
+// streamed profile from idx when they are not all cached. NULL on a read
+// error; idx + count must not be past the end.
+static const profile_sample_t* profile_samples(profile_t* profile, uint32_t idx, uint32_t count)
 {
-  if(seconds > 703)
+  if(profile->samples)
+    return &profile->samples[idx];
+
+  if(idx < profile->window_start || idx + count > profile->window_start + profile->window_rows)
   {
-    row_t def = {
-      .rot_y = 0.0,
-      .accel_x = 0.0,
-      .rot_x = 0.0,
-      .stage = 0
-    };
-    return def;
+    uint32_t rows = profile->header.rows - idx;
+    if(rows > PROFILE_WINDOW)
+      rows = PROFILE_WINDOW;
+
+    uint64_t offset = sizeof(profile_header_t) + (uint64_t)idx * sizeof(profile_sample_t);
+    profile->window_rows = 0;
+    if(!profile->read(profile->context, offset, profile->window, rows * sizeof(profile_sample_t)))
+      return NULL;
+    profile->window_start = idx;
+    profile->window_rows  = rows;
   }
-  return rows[seconds];
+  return &profile->window[idx - profile->window_start];
+}
+
+static double profile_lerp(int32_t a, int32_t b, double t)
+{
+  return (a + (b - a) * t) / PROFILE_SCALE;
 }
 
-void profile_load_json(cJSON *json)
+// Samples are interpolated linearly in between their time steps; the stage
+// is taken from the sample at or before millis. The last sample holds for
+// one step and everything after it reads as zero.
+row_t profile_get_data(profile_t* profile, uint64_t millis)
 {
-  cJSON *row = NULL;
-  cJSON_ArrayForEach(row, json) {   // <— looping macro
+  row_t row = {0};
+  if(!profile || !profile->header.rows)
+    return row;
 
-    cJSON* elems = row->child;
+  uint64_t idx = millis / profile->header.step_ms;
+  if(idx >= profile->header.rows)
+    return row;
 
-    int idx = elems->valueint;
-    elems = elems->next;
-    row_t* data_row = &rows[idx];
-    data_row->rot_y = elems->valuedouble;
-    elems = elems->next;
-    data_row->accel_x = elems->valuedouble;
-    elems = elems->next;
-    data_row->rot_x = elems->valuedouble;
-    elems = elems->next;
-    data_row->stage = elems->valueint;
-    elems = elems->next;
-  }
+  uint32_t count = idx + 1 < profile->header.rows ? 2 : 1;
+  const profile_sample_t* a = profile_samples(profile, idx, count);
+  if(!a)
+    return row;
+  const profile_sample_t* b = &a[count - 1];
+
+  double t    = (double)(millis % profile->header.step_ms) / profile->header.step_ms;
+  row.rot_y   = profile_lerp(a->rot_y, b->rot_y, t);
+  row.accel_x = profile_lerp(a->accel_x, b->accel_x, t);
+  row.rot_x   = profile_lerp(a->rot_x, b->rot_x, t);
+  row.stage   = a->stage;
+  return row;
 }
 
+// Points the profile at a binary image without copying it, so that on the
+// Pico the samples are read straight from flash. Fails if the header does not
+// describe this version of the format or the image is truncated.
+bool profile_map(profile_t* profile, const uint8_t* data, uint64_t len)
+{
+  memset(profile, 0, sizeof(profile_t));
 
-const char*  test = "["
-"  [  0,  0.000,  1.000,  0.000, 0],"
-"  [  1,  0.000,  1.000,  0.000, 0],"
-"  [  2,  0.000,  1.000,  0.000, 0],"
-"  [  3,  0.000,  1.000,  0.000, 0],"
-"  [  4,  0.000,  1.000,  0.000, 0],"
-"  [  5,  0.000,  1.000,  0.000, 0],"
-"  [  6,  0.000,  1.000,  0.000, 0],"
-"  [  7,  0.000,  1.000,  0.000, 0],"
-"  [  8,  0.000,  1.000,  0.000, 0],"
-"  [  9,  0.000,  1.000,  0.000, 0],"
-"  [ 10,  0.000,  1.000,  0.000, 0],"
-"  [ 11,  0.000,  1.000,  0.000, 0],"
-"  [ 12, -0.139,  1.051,  1.000, 0],"
-"  [ 13, -0.278,  1.102,  1.000, 0],"
-"  [ 14, -0.278,  1.102,  1.000, 0],"
-"  [ 15, -0.278,  1.102,  1.000, 0],"
-"  [ 16, -0.278,  1.102,  1.000, 0],"
-"  [ 17, -0.278,  1.102,  1.000, 0],"
-"  [ 18, -0.278,  1.101,  1.000, 0],"
-"  [ 19, -0.278,  1.101,  1.000, 0],"
-"  [ 20, -0.278,  1.101,  1.000, 0],"
-"  [ 21, -0.278,  1.101,  1.000, 0],"
-"  [ 22, -0.278,  1.101,  1.000, 0],"
-"  [ 23, -0.278,  1.100,  1.000, 0],"
-"  [ 24, -0.278,  1.100,  1.000, 0],"
-"  [ 25, -0.278,  1.100,  1.000, 0],"
-"  [ 26, -0.278,  1.100,  1.000, 0],"
-"  [ 27, -0.278,  1.099,  1.000, 0],"
-"  [ 28, -0.278,  1.099,  1.000, 0],"
-"  [ 29, -0.278,  1.098,  1.000, 0],"
-"  [ 30, -0.422,  1.297,  0.000, 0],"
-"  [ 31, -0.567,  1.496,  0.000, 0],"
-"  [ 32, -0.567,  1.495,  0.000, 0],"
-"  [ 33, -0.567,  1.494,  0.000, 0],"
-"  [ 34, -0.567,  1.492,  0.000, 0],"
-"  [ 35, -0.567,  1.491,  0.000, 0],"
-"  [ 36, -0.567,  1.490,  0.000, 0],"
-"  [ 37, -0.567,  1.488,  0.000, 0],"
-"  [ 38, -0.567,  1.487,  0.000, 0],"
-"  [ 39, -0.567,  1.485,  0.000, 0],"
-"  [ 40, -0.567,  1.483,  0.000, 0],"
-"  [ 41, -0.567,  1.481,  0.000, 0],"
-"  [ 42, -0.567,  1.479,  0.000, 0],"
-"  [ 43, -0.567,  1.477,  0.000, 0],"
-"  [ 44, -0.567,  1.475,  0.000, 0],"
-"  [ 45, -0.567,  1.473,  0.000, 0],"
-"  [ 46, -0.567,  1.470,  0.000, 0],"
-"  [ 47, -0.567,  1.468,  0.000, 0],"
-"  [ 48, -0.567,  1.465,  0.000, 0],"
-"  [ 49, -0.567,  1.462,  0.000, 0],"
-"  [ 50, -0.567,  1.460,  0.000, 0],"
-"  [ 51, -0.567,  1.457,  0.000, 0],"
-"  [ 52, -0.567,  1.454,  0.000, 0],"
-"  [ 53, -0.567,  1.451,  0.000, 0],"
-"  [ 54, -0.567,  1.448,  0.000, 0],"
-"  [ 55, -0.567,  1.444,  0.000, 0],"
-"  [ 56, -0.567,  1.441,  0.000, 0],"
-"  [ 57, -0.567,  1.438,  0.000, 0],"
-"  [ 58, -0.567,  1.434,  0.000, 0],"
-"  [ 59, -0.567,  1.431,  0.000, 0],"
-"  [ 60, -0.600,  1.778,  0.000, 0],"
-"  [ 61, -0.633,  2.125,  0.000, 0],"
-"  [ 62, -0.633,  2.121,  0.000, 0],"
-"  [ 63, -0.633,  2.116,  0.000, 0],"
-"  [ 64, -0.633,  2.112,  0.000, 0],"
-"  [ 65, -0.633,  2.107,  0.000, 0],"
-"  [ 66, -0.633,  2.102,  0.000, 0],"
-"  [ 67, -0.633,  2.097,  0.000, 0],"
-"  [ 68, -0.633,  2.092,  0.000, 0],"
-"  [ 69, -0.633,  2.087,  0.000, 0],"
-"  [ 70, -0.633,  2.082,  0.000, 0],"
-"  [ 71, -0.633,  2.076,  0.000, 0],"
-"  [ 72, -0.633,  2.071,  0.000, 0],"
-"  [ 73, -0.633,  2.065,  0.000, 0],"
-"  [ 74, -0.633,  2.059,  0.000, 0],"
-"  [ 75, -0.633,  2.053,  0.000, 0],"
-"  [ 76, -0.633,  2.047,  0.000, 0],"
-"  [ 77, -0.633,  2.041,  0.000, 0],"
-"  [ 78, -0.633,  2.035,  0.000, 0],"
-"  [ 79, -0.633,  2.029,  0.000, 0],"
-"  [ 80, -0.633,  2.023,  0.000, 0],"
-"  [ 81, -0.633,  2.016,  0.000, 0],"
-"  [ 82, -0.633,  2.009,  0.000, 0],"
-"  [ 83, -0.633,  2.003,  0.000, 0],"
-"  [ 84, -0.633,  1.996,  0.000, 0],"
-"  [ 85, -0.633,  1.989,  0.000, 0],"
-"  [ 86, -0.633,  1.982,  0.000, 0],"
-"  [ 87, -0.633,  1.975,  0.000, 0],"
-"  [ 88, -0.633,  1.968,  0.000, 0],"
-"  [ 89, -0.633,  1.961,  0.000, 0],"
-"  [ 90, -0.567,  2.410,  0.000, 0],"
-"  [ 91, -0.500,  2.861,  0.000, 0],"
-"  [ 92, -0.500,  2.855,  0.000, 0],"
-"  [ 93, -0.500,  2.849,  0.000, 0],"
-"  [ 94, -0.500,  2.843,  0.000, 0],"
-"  [ 95, -0.500,  2.836,  0.000, 0],"
-"  [ 96, -0.500,  2.830,  0.000, 0],"
-"  [ 97, -0.500,  2.824,  0.000, 0],"
-"  [ 98, -0.500,  2.817,  0.000, 0],"
-"  [ 99, -0.500,  2.811,  0.000, 0],"
-"  [100, -0.500,  2.804,  0.000, 0],"
-"  [101, -0.500,  2.797,  0.000, 0],"
-"  [102, -0.500,  2.791,  0.000, 0],"
-"  [103, -0.500,  2.784,  0.000, 0],"
-"  [104, -0.500,  2.777,  0.000, 0],"
-"  [105, -0.500,  2.770,  0.000, 0],"
-"  [106, -0.500,  2.763,  0.000, 0],"
-"  [107, -0.500,  2.756,  0.000, 0],"
-"  [108, -0.500,  2.749,  0.000, 0],"
-"  [109, -0.500,  2.742,  0.000, 0],"
-"  [110, -0.500,  2.735,  0.000, 0],"
-"  [111, -0.500,  2.728,  0.000, 0],"
-"  [112, -0.500,  2.721,  0.000, 0],"
-"  [113, -0.500,  2.714,  0.000, 0],"
-"  [114, -0.500,  2.706,  0.000, 0],"
-"  [115, -0.500,  2.699,  0.000, 0],"
-"  [116, -0.500,  2.691,  0.000, 0],"
-"  [117, -0.500,  2.684,  0.000, 0],"
-"  [118, -0.500,  2.676,  0.000, 0],"
-"  [119, -0.500,  2.669,  0.000, 0],"
-"  [120, -0.417,  3.067,  0.000, 0],"
-"  [121, -0.333,  3.468,  0.000, 0],"
-"  [122, -0.333,  3.462,  0.000, 0],"
-"  [123, -0.333,  3.457,  0.000, 0],"
-"  [124, -0.333,  3.452,  0.000, 0],"
-"  [125, -0.333,  3.446,  0.000, 0],"
-"  [126, -0.333,  3.441,  0.000, 0],"
-"  [127, -0.333,  3.435,  0.000, 0],"
-"  [128, -0.333,  3.430,  0.000, 0],"
-"  [129, -0.333,  3.424,  0.000, 0],"
-"  [130, -0.333,  3.419,  0.000, 0],"
-"  [131, -0.333,  3.413,  0.000, 0],"
-"  [132, -0.333,  3.407,  0.000, 0],"
-"  [133, -0.333,  3.402,  0.000, 0],"
-"  [134, -0.333,  3.396,  0.000, 0],"
-"  [135, -0.333,  3.390,  0.000, 0],"
-"  [136, -0.333,  3.385,  0.000, 0],"
-"  [137, -0.333,  3.379,  0.000, 0],"
-"  [138, -0.292,  3.358,  0.000, 0],"
-"  [139, -0.250,  3.339,  0.000, 0],"
-"  [140, -0.250,  3.334,  0.000, 0],"
-"  [141, -0.250,  3.330,  0.000, 0],"
-"  [142, -0.250,  3.325,  0.000, 0],"
-"  [143, -0.250,  3.321,  0.000, 0],"
-"  [144, -0.250,  3.316,  0.000, 0],"
-"  [145, -0.250,  3.312,  0.000, 0],"
-"  [146, -0.250,  3.307,  0.000, 0],"
-"  [147, -0.250,  3.303,  0.000, 0],"
-"  [148, -0.250,  3.298,  0.000, 0],"
-"  [149, -0.250,  3.294,  0.000, 0],"
-"  [150, -0.261,  3.357,  0.000, 0],"
-"  [151, -0.273,  3.421,  0.000, 0],"
-"  [152, -0.273,  3.416,  0.000, 0],"
-"  [153, -0.273,  3.411,  0.000, 0],"
-"  [154, -0.273,  3.406,  0.000, 0],"
-"  [155, -0.273,  3.401,  0.000, 0],"
-"  [156, -0.273,  3.396,  0.000, 0],"
-"  [157, -0.273,  3.391,  0.000, 0],"
-"  [158, -0.273,  3.386,  0.000, 0],"
-"  [159, -0.273,  3.381,  0.000, 0],"
-"  [160, -0.273,  3.376,  0.000, 0],"
-"  [161, -0.136,  2.008,  0.000, 1],"
-"  [162,  0.000,  0.644,  0.000, 0],"
-"  [163,  0.000,  0.644,  0.000, 0],"
-"  [164,  0.000,  0.644,  0.000, 0],"
-"  [165,  0.000,  0.644,  0.000, 0],"
-"  [166,  0.000,  0.644,  0.000, 0],"
-"  [167,  0.000,  0.644,  0.000, 0],"
-"  [168,  0.000,  0.644,  0.000, 0],"
-"  [169,  0.000,  0.644,  0.000, 0],"
-"  [170,  0.000,  0.644,  0.000, 0],"
-"  [171,  0.000,  0.643,  0.000, 0],"
-"  [172,  0.000,  0.643,  0.000, 0],"
-"  [173,  0.000,  0.643,  0.000, 0],"
-"  [174,  0.000,  0.643,  0.000, 0],"
-"  [175,  0.000,  0.643,  0.000, 0],"
-"  [176,  0.000,  0.643,  0.000, 0],"
-"  [177,  0.000,  0.643,  0.000, 0],"
-"  [178,  0.000,  0.643,  0.000, 0],"
-"  [179,  0.000,  0.643,  0.000, 0],"
-"  [180,  0.033,  0.768,  0.000, 0],"
-"  [181,  0.067,  0.893,  0.000, 0],"
-"  [182,  0.067,  0.894,  0.000, 0],"
-"  [183,  0.067,  0.895,  0.000, 0],"
-"  [184,  0.067,  0.896,  0.000, 0],"
-"  [185,  0.067,  0.897,  0.000, 0],"
-"  [186,  0.067,  0.898,  0.000, 0],"
-"  [187,  0.067,  0.898,  0.000, 0],"
-"  [188,  0.067,  0.899,  0.000, 0],"
-"  [189,  0.067,  0.900,  0.000, 0],"
-"  [190,  0.067,  0.901,  0.000, 0],"
-"  [191,  0.067,  0.902,  0.000, 0],"
-"  [192,  0.067,  0.903,  0.000, 0],"
-"  [193,  0.067,  0.904,  0.000, 0],"
-"  [194,  0.067,  0.904,  0.000, 0],"
-"  [195,  0.067,  0.905,  0.000, 0],"
-"  [196,  0.067,  0.906,  0.000, 0],"
-"  [197,  0.067,  0.907,  0.000, 0],"
-"  [198,  0.067,  0.908,  0.000, 0],"
-"  [199,  0.067,  0.909,  0.000, 0],"
-"  [200,  0.067,  0.909,  0.000, 0],"
-"  [201,  0.067,  0.910,  0.000, 0],"
-"  [202,  0.067,  0.911,  0.000, 0],"
-"  [203,  0.067,  0.912,  0.000, 0],"
-"  [204,  0.067,  0.913,  0.000, 0],"
-"  [205,  0.067,  0.913,  0.000, 0],"
-"  [206,  0.067,  0.914,  0.000, 0],"
-"  [207,  0.067,  0.915,  0.000, 0],"
-"  [208,  0.067,  0.916,  0.000, 0],"
-"  [209,  0.067,  0.917,  0.000, 0],"
-"  [210, -0.017,  0.970,  0.000, 0],"
-"  [211, -0.100,  1.021,  0.000, 0],"
-"  [212, -0.100,  1.019,  0.000, 0],"
-"  [213, -0.100,  1.017,  0.000, 0],"
-"  [214, -0.100,  1.015,  0.000, 0],"
-"  [215, -0.100,  1.014,  0.000, 0],"
-"  [216, -0.100,  1.012,  0.000, 0],"
-"  [217, -0.100,  1.010,  0.000, 0],"
-"  [218, -0.100,  1.009,  0.000, 0],"
-"  [219, -0.100,  1.007,  0.000, 0],"
-"  [220, -0.100,  1.005,  0.000, 0],"
-"  [221, -0.100,  1.004,  0.000, 0],"
-"  [222, -0.100,  1.002,  0.000, 0],"
-"  [223, -0.100,  1.000,  0.000, 0],"
-"  [224, -0.100,  0.999,  0.000, 0],"
-"  [225, -0.100,  0.997,  0.000, 0],"
-"  [226, -0.100,  0.995,  0.000, 0],"
-"  [227, -0.100,  0.994,  0.000, 0],"
-"  [228, -0.100,  0.992,  0.000, 0],"
-"  [229, -0.100,  0.990,  0.000, 0],"
-"  [230, -0.100,  0.988,  0.000, 0],"
-"  [231, -0.100,  0.987,  0.000, 0],"
-"  [232, -0.100,  0.985,  0.000, 0],"
-"  [233, -0.100,  0.983,  0.000, 0],"
-"  [234, -0.100,  0.982,  0.000, 0],"
-"  [235, -0.100,  0.980,  0.000, 0],"
-"  [236, -0.100,  0.978,  0.000, 0],"
-"  [237, -0.100,  0.977,  0.000, 0],"
-"  [238, -0.100,  0.975,  0.000, 0],"
-"  [239, -0.100,  0.973,  0.000, 0],"
-"  [240, -0.083,  1.023,  0.000, 0],"
-"  [241, -0.067,  1.073,  0.000, 0],"
-"  [242, -0.067,  1.072,  0.000, 0],"
-"  [243, -0.067,  1.071,  0.000, 0],"
-"  [244, -0.067,  1.069,  0.000, 0],"
-"  [245, -0.067,  1.068,  0.000, 0],"
-"  [246, -0.067,  1.067,  0.000, 0],"
-"  [247, -0.067,  1.066,  0.000, 0],"
-"  [248, -0.067,  1.065,  0.000, 0],"
-"  [249, -0.067,  1.063,  0.000, 0],"
-"  [250, -0.067,  1.062,  0.000, 0],"
-"  [251, -0.067,  1.061,  0.000, 0],"
-"  [252, -0.067,  1.060,  0.000, 0],"
-"  [253, -0.067,  1.059,  0.000, 0],"
-"  [254, -0.067,  1.057,  0.000, 0],"
-"  [255, -0.067,  1.056,  0.000, 0],"
-"  [256, -0.067,  1.055,  0.000, 0],"
-"  [257, -0.067,  1.054,  0.000, 0],"
-"  [258, -0.067,  1.053,  0.000, 0],"
-"  [259, -0.067,  1.051,  0.000, 0],"
-"  [260, -0.067,  1.050,  0.000, 0],"
-"  [261, -0.067,  1.049,  0.000, 0],"
-"  [262, -0.067,  1.048,  0.000, 0],"
-"  [263, -0.067,  1.046,  0.000, 0],"
-"  [264, -0.067,  1.045,  0.000, 0],"
-"  [265, -0.067,  1.044,  0.000, 0],"
-"  [266, -0.067,  1.043,  0.000, 0],"
-"  [267, -0.067,  1.042,  0.000, 0],"
-"  [268, -0.067,  1.040,  0.000, 0],"
-"  [269, -0.067,  1.039,  0.000, 0],"
-"  [270, -0.067,  1.088,  0.000, 0],"
-"  [271, -0.067,  1.137,  0.000, 0],"
-"  [272, -0.067,  1.136,  0.000, 0],"
-"  [273, -0.067,  1.135,  0.000, 0],"
-"  [274, -0.067,  1.134,  0.000, 0],"
-"  [275, -0.067,  1.132,  0.000, 0],"
-"  [276, -0.067,  1.131,  0.000, 0],"
-"  [277, -0.067,  1.130,  0.000, 0],"
-"  [278, -0.067,  1.129,  0.000, 0],"
-"  [279, -0.067,  1.128,  0.000, 0],"
-"  [280, -0.067,  1.126,  0.000, 0],"
-"  [281, -0.067,  1.125,  0.000, 0],"
-"  [282, -0.067,  1.124,  0.000, 0],"
-"  [283, -0.067,  1.123,  0.000, 0],"
-"  [284, -0.067,  1.121,  0.000, 0],"
-"  [285, -0.067,  1.120,  0.000, 0],"
-"  [286, -0.067,  1.119,  0.000, 0],"
-"  [287, -0.067,  1.118,  0.000, 0],"
-"  [288, -0.067,  1.117,  0.000, 0],"
-"  [289, -0.067,  1.115,  0.000, 0],"
-"  [290, -0.067,  1.114,  0.000, 0],"
-"  [291, -0.067,  1.113,  0.000, 0],"
-"  [292, -0.067,  1.112,  0.000, 0],"
-"  [293, -0.067,  1.111,  0.000, 0],"
-"  [294, -0.067,  1.109,  0.000, 0],"
-"  [295, -0.067,  1.108,  0.000, 0],"
-"  [296, -0.067,  1.107,  0.000, 0],"
-"  [297, -0.067,  1.106,  0.000, 0],"
-"  [298, -0.067,  1.105,  0.000, 0],"
-"  [299, -0.067,  1.103,  0.000, 0],"
-"  [300, -0.083,  1.156,  0.000, 0],"
-"  [301, -0.100,  1.207,  0.000, 0],"
-"  [302, -0.100,  1.205,  0.000, 0],"
-"  [303, -0.100,  1.204,  0.000, 0],"
-"  [304, -0.100,  1.202,  0.000, 0],"
-"  [305, -0.100,  1.200,  0.000, 0],"
-"  [306, -0.100,  1.199,  0.000, 0],"
-"  [307, -0.100,  1.197,  0.000, 0],"
-"  [308, -0.100,  1.195,  0.000, 0],"
-"  [309, -0.100,  1.194,  0.000, 0],"
-"  [310, -0.100,  1.192,  0.000, 0],"
-"  [311, -0.100,  1.190,  0.000, 0],"
-"  [312, -0.100,  1.189,  0.000, 0],"
-"  [313, -0.100,  1.187,  0.000, 0],"
-"  [314, -0.100,  1.185,  0.000, 0],"
-"  [315, -0.100,  1.184,  0.000, 0],"
-"  [316, -0.100,  1.182,  0.000, 0],"
-"  [317, -0.100,  1.180,  0.000, 0],"
-"  [318, -0.100,  1.179,  0.000, 0],"
-"  [319, -0.100,  1.177,  0.000, 0],"
-"  [320, -0.100,  1.175,  0.000, 0],"
-"  [321, -0.100,  1.174,  0.000, 0],"
-"  [322, -0.100,  1.172,  0.000, 0],"
-"  [323, -0.100,  1.170,  0.000, 0],"
-"  [324, -0.100,  1.169,  0.000, 0],"
-"  [325, -0.100,  1.167,  0.000, 0],"
-"  [326, -0.100,  1.165,  0.000, 0],"
-"  [327, -0.100,  1.164,  0.000, 0],"
-"  [328, -0.100,  1.162,  0.000, 0],"
-"  [329, -0.100,  1.161,  0.000, 0],"
-"  [330, -0.083,  1.215,  0.000, 0],"
-"  [331, -0.067,  1.271,  0.000, 0],"
-"  [332, -0.067,  1.269,  0.000, 0],"
-"  [333, -0.067,  1.268,  0.000, 0],"
-"  [334, -0.067,  1.267,  0.000, 0],"
-"  [335, -0.067,  1.266,  0.000, 0],"
-"  [336, -0.067,  1.265,  0.000, 0],"
-"  [337, -0.067,  1.263,  0.000, 0],"
-"  [338, -0.067,  1.262,  0.000, 0],"
-"  [339, -0.067,  1.261,  0.000, 0],"
-"  [340, -0.067,  1.260,  0.000, 0],"
-"  [341, -0.067,  1.259,  0.000, 0],"
-"  [342, -0.067,  1.258,  0.000, 0],"
-"  [343, -0.067,  1.256,  0.000, 0],"
-"  [344, -0.067,  1.255,  0.000, 0],"
-"  [345, -0.067,  1.254,  0.000, 0],"
-"  [346, -0.067,  1.253,  0.000, 0],"
-"  [347, -0.067,  1.252,  0.000, 0],"
-"  [348, -0.067,  1.250,  0.000, 0],"
-"  [349, -0.067,  1.249,  0.000, 0],"
-"  [350, -0.067,  1.248,  0.000, 0],"
-"  [351, -0.067,  1.247,  0.000, 0],"
-"  [352, -0.067,  1.246,  0.000, 0],"
-"  [353, -0.067,  1.245,  0.000, 0],"
-"  [354, -0.067,  1.244,  0.000, 0],"
-"  [355, -0.067,  1.242,  0.000, 0],"
-"  [356, -0.067,  1.241,  0.000, 0],"
-"  [357, -0.067,  1.240,  0.000, 0],"
-"  [358, -0.067,  1.239,  0.000, 0],"
-"  [359, -0.067,  1.238,  0.000, 0],"
-"  [360, -0.083,  1.299,  0.000, 0],"
-"  [361, -0.100,  1.360,  0.000, 0],"
-"  [362, -0.100,  1.359,  0.000, 0],"
-"  [363, -0.100,  1.357,  0.000, 0],"
-"  [364, -0.100,  1.356,  0.000, 0],"
-"  [365, -0.100,  1.354,  0.000, 0],"
-"  [366, -0.100,  1.352,  0.000, 0],"
-"  [367, -0.100,  1.351,  0.000, 0],"
-"  [368, -0.100,  1.349,  0.000, 0],"
-"  [369, -0.100,  1.348,  0.000, 0],"
-"  [370, -0.100,  1.346,  0.000, 0],"
-"  [371, -0.100,  1.345,  0.000, 0],"
-"  [372, -0.100,  1.343,  0.000, 0],"
-"  [373, -0.100,  1.342,  0.000, 0],"
-"  [374, -0.100,  1.340,  0.000, 0],"
-"  [375, -0.100,  1.338,  0.000, 0],"
-"  [376, -0.100,  1.337,  0.000, 0],"
-"  [377, -0.100,  1.335,  0.000, 0],"
-"  [378, -0.100,  1.334,  0.000, 0],"
-"  [379, -0.100,  1.332,  0.000, 0],"
-"  [380, -0.100,  1.331,  0.000, 0],"
-"  [381, -0.100,  1.329,  0.000, 0],"
-"  [382, -0.100,  1.328,  0.000, 0],"
-"  [383, -0.100,  1.326,  0.000, 0],"
-"  [384, -0.100,  1.325,  0.000, 0],"
-"  [385, -0.100,  1.323,  0.000, 0],"
-"  [386, -0.100,  1.322,  0.000, 0],"
-"  [387, -0.100,  1.320,  0.000, 0],"
-"  [388, -0.100,  1.319,  0.000, 0],"
-"  [389, -0.100,  1.317,  0.000, 0],"
-"  [390, -0.100,  1.388,  0.000, 0],"
-"  [391, -0.100,  1.459,  0.000, 0],"
-"  [392, -0.100,  1.457,  0.000, 0],"
-"  [393, -0.100,  1.456,  0.000, 0],"
-"  [394, -0.100,  1.454,  0.000, 0],"
-"  [395, -0.100,  1.453,  0.000, 0],"
-"  [396, -0.100,  1.451,  0.000, 0],"
-"  [397, -0.100,  1.450,  0.000, 0],"
-"  [398, -0.100,  1.448,  0.000, 0],"
-"  [399, -0.100,  1.447,  0.000, 0],"
-"  [400, -0.100,  1.445,  0.000, 0],"
-"  [401, -0.100,  1.444,  0.000, 0],"
-"  [402, -0.100,  1.443,  0.000, 0],"
-"  [403, -0.100,  1.441,  0.000, 0],"
-"  [404, -0.100,  1.440,  0.000, 0],"
-"  [405, -0.100,  1.438,  0.000, 0],"
-"  [406, -0.100,  1.437,  0.000, 0],"
-"  [407, -0.100,  1.436,  0.000, 0],"
-"  [408, -0.100,  1.434,  0.000, 0],"
-"  [409, -0.100,  1.433,  0.000, 0],"
-"  [410, -0.100,  1.432,  0.000, 0],"
-"  [411, -0.100,  1.430,  0.000, 0],"
-"  [412, -0.100,  1.429,  0.000, 0],"
-"  [413, -0.100,  1.427,  0.000, 0],"
-"  [414, -0.100,  1.426,  0.000, 0],"
-"  [415, -0.100,  1.425,  0.000, 0],"
-"  [416, -0.100,  1.423,  0.000, 0],"
-"  [417, -0.100,  1.422,  0.000, 0],"
-"  [418, -0.100,  1.421,  0.000, 0],"
-"  [419, -0.100,  1.420,  0.000, 0],"
-"  [420, -0.100,  1.502,  0.000, 0],"
-"  [421, -0.100,  1.584,  0.000, 0],"
-"  [422, -0.100,  1.582,  0.000, 0],"
-"  [423, -0.100,  1.581,  0.000, 0],"
-"  [424, -0.100,  1.580,  0.000, 0],"
-"  [425, -0.100,  1.579,  0.000, 0],"
-"  [426, -0.100,  1.577,  0.000, 0],"
-"  [427, -0.100,  1.576,  0.000, 0],"
-"  [428, -0.100,  1.575,  0.000, 0],"
-"  [429, -0.100,  1.573,  0.000, 0],"
-"  [430, -0.100,  1.572,  0.000, 0],"
-"  [431, -0.100,  1.571,  0.000, 0],"
-"  [432, -0.100,  1.570,  0.000, 0],"
-"  [433, -0.100,  1.569,  0.000, 0],"
-"  [434, -0.100,  1.567,  0.000, 0],"
-"  [435, -0.100,  1.566,  0.000, 0],"
-"  [436, -0.100,  1.565,  0.000, 0],"
-"  [437, -0.100,  1.564,  0.000, 0],"
-"  [438, -0.100,  1.563,  0.000, 0],"
-"  [439, -0.100,  1.561,  0.000, 0],"
-"  [440, -0.100,  1.560,  0.000, 0],"
-"  [441, -0.100,  1.559,  0.000, 0],"
-"  [442, -0.100,  1.558,  0.000, 0],"
-"  [443, -0.100,  1.557,  0.000, 0],"
-"  [444, -0.100,  1.556,  0.000, 0],"
-"  [445, -0.100,  1.554,  0.000, 0],"
-"  [446, -0.100,  1.553,  0.000, 0],"
-"  [447, -0.100,  1.552,  0.000, 0],"
-"  [448, -0.100,  1.551,  0.000, 0],"
-"  [449, -0.100,  1.550,  0.000, 0],"
-"  [450,  0.000,  1.524,  0.000, 0],"
-"  [451,  0.100,  1.500,  0.000, 0],"
-"  [452,  0.100,  1.501,  0.000, 0],"
-"  [453,  0.100,  1.502,  0.000, 0],"
-"  [454,  0.100,  1.502,  0.000, 0],"
-"  [455,  0.100,  1.503,  0.000, 0],"
-"  [456,  0.100,  1.504,  0.000, 0],"
-"  [457,  0.100,  1.505,  0.000, 0],"
-"  [458,  0.100,  1.506,  0.000, 0],"
-"  [459,  0.100,  1.506,  0.000, 0],"
-"  [460,  0.100,  1.507,  0.000, 0],"
-"  [461,  0.100,  1.508,  0.000, 0],"
-"  [462,  0.100,  1.508,  0.000, 0],"
-"  [463,  0.100,  1.509,  0.000, 0],"
-"  [464,  0.100,  1.510,  0.000, 0],"
-"  [465,  0.100,  1.511,  0.000, 0],"
-"  [466,  0.100,  1.511,  0.000, 0],"
-"  [467,  0.100,  1.512,  0.000, 0],"
-"  [468,  0.100,  1.513,  0.000, 0],"
-"  [469,  0.100,  1.513,  0.000, 0],"
-"  [470,  0.100,  1.514,  0.000, 0],"
-"  [471,  0.100,  1.514,  0.000, 0],"
-"  [472,  0.100,  1.515,  0.000, 0],"
-"  [473,  0.100,  1.516,  0.000, 0],"
-"  [474,  0.100,  1.516,  0.000, 0],"
-"  [475,  0.100,  1.517,  0.000, 0],"
-"  [476,  0.100,  1.518,  0.000, 0],"
-"  [477,  0.100,  1.518,  0.000, 0],"
-"  [478,  0.100,  1.519,  0.000, 0],"
-"  [479,  0.100,  1.519,  0.000, 0],"
-"  [480, -0.050,  1.487,  0.000, 0],"
-"  [481, -0.200,  1.452,  0.000, 0],"
-"  [482, -0.200,  1.450,  0.000, 0],"
-"  [483, -0.200,  1.448,  0.000, 0],"
-"  [484, -0.200,  1.446,  0.000, 0],"
-"  [485, -0.200,  1.444,  0.000, 0],"
-"  [486, -0.200,  1.442,  0.000, 0],"
-"  [487, -0.200,  1.441,  0.000, 0],"
-"  [488, -0.200,  1.439,  0.000, 0],"
-"  [489, -0.200,  1.437,  0.000, 0],"
-"  [490, -0.200,  1.435,  0.000, 0],"
-"  [491, -0.200,  1.434,  0.000, 0],"
-"  [492, -0.200,  1.432,  0.000, 0],"
-"  [493, -0.200,  1.430,  0.000, 0],"
-"  [494, -0.200,  1.429,  0.000, 0],"
-"  [495, -0.200,  1.427,  0.000, 0],"
-"  [496, -0.200,  1.425,  0.000, 0],"
-"  [497, -0.200,  1.424,  0.000, 0],"
-"  [498, -0.200,  1.422,  0.000, 0],"
-"  [499, -0.200,  1.421,  0.000, 0],"
-"  [500, -0.200,  1.419,  0.000, 0],"
-"  [501, -0.200,  1.418,  0.000, 0],"
-"  [502, -0.200,  1.416,  0.000, 0],"
-"  [503, -0.200,  1.415,  0.000, 0],"
-"  [504, -0.200,  1.413,  0.000, 0],"
-"  [505, -0.200,  1.412,  0.000, 0],"
-"  [506, -0.200,  1.410,  0.000, 0],"
-"  [507, -0.200,  1.409,  0.000, 0],"
-"  [508, -0.200,  1.408,  0.000, 0],"
-"  [509, -0.200,  1.406,  0.000, 0],"
-"  [510, -0.150,  1.420,  0.000, 0],"
-"  [511, -0.100,  1.434,  0.000, 0],"
-"  [512, -0.100,  1.434,  0.000, 0],"
-"  [513, -0.100,  1.433,  0.000, 0],"
-"  [514, -0.100,  1.432,  0.000, 0],"
-"  [515, -0.100,  1.432,  0.000, 0],"
-"  [516, -0.100,  1.431,  0.000, 0],"
-"  [517, -0.100,  1.430,  0.000, 0],"
-"  [518, -0.100,  1.430,  0.000, 0],"
-"  [519, -0.100,  1.429,  0.000, 0],"
-"  [520, -0.100,  1.429,  0.000, 0],"
-"  [521, -0.100,  1.428,  0.000, 0],"
-"  [522, -0.100,  1.428,  0.000, 0],"
-"  [523, -0.100,  1.427,  0.000, 0],"
-"  [524, -0.100,  1.427,  0.000, 0],"
-"  [525, -0.100,  1.426,  0.000, 0],"
-"  [526, -0.100,  1.426,  0.000, 0],"
-"  [527, -0.100,  1.425,  0.000, 0],"
-"  [528, -0.100,  1.425,  0.000, 0],"
-"  [529, -0.100,  1.424,  0.000, 0],"
-"  [530, -0.100,  1.424,  0.000, 0],"
-"  [531, -0.100,  1.423,  0.000, 0],"
-"  [532, -0.100,  1.423,  0.000, 0],"
-"  [533, -0.100,  1.422,  0.000, 0],"
-"  [534, -0.100,  1.422,  0.000, 0],"
-"  [535, -0.100,  1.421,  0.000, 0],"
-"  [536, -0.100,  1.421,  0.000, 0],"
-"  [537, -0.100,  1.421,  0.000, 0],"
-"  [538, -0.100,  1.420,  0.000, 0],"
-"  [539, -0.100,  1.420,  0.000, 0],"
-"  [540, -0.106,  1.450,  0.000, 0],"
-"  [541, -0.111,  1.479,  0.000, 0],"
-"  [542, -0.111,  1.479,  0.000, 0],"
-"  [543, -0.111,  1.479,  0.000, 0],"
-"  [544, -0.111,  1.478,  0.000, 0],"
-"  [545, -0.111,  1.478,  0.000, 0],"
-"  [546, -0.111,  1.478,  0.000, 0],"
-"  [547, -0.111,  1.477,  0.000, 0],"
-"  [548, -0.111,  1.477,  0.000, 0],"
-"  [549, -0.111,  1.477,  0.000, 0],"
-"  [550, -0.111,  1.476,  0.000, 0],"
-"  [551, -0.111,  1.476,  0.000, 0],"
-"  [552, -0.111,  1.476,  0.000, 0],"
-"  [553, -0.111,  1.475,  0.000, 0],"
-"  [554, -0.111,  1.475,  0.000, 0],"
-"  [555, -0.111,  1.475,  0.000, 0],"
-"  [556, -0.111,  1.475,  0.000, 0],"
-"  [557, -0.111,  1.474,  0.000, 0],"
-"  [558, -0.139,  0.894,  0.000, 2],"
-"  [559, -0.167,  0.312,  0.000, 0],"
-"  [560, -0.167,  0.312,  0.000, 0],"
-"  [561, -0.167,  0.311,  0.000, 0],"
-"  [562, -0.167,  0.310,  0.000, 0],"
-"  [563, -0.167,  0.310,  0.000, 0],"
-"  [564, -0.167,  0.309,  0.000, 0],"
-"  [565, -0.167,  0.308,  0.000, 0],"
-"  [566, -0.167,  0.307,  0.000, 0],"
-"  [567, -0.167,  0.307,  0.000, 0],"
-"  [568, -0.167,  0.306,  0.000, 0],"
-"  [569, -0.167,  0.305,  0.000, 0],"
-"  [570, -0.133,  0.416,  0.000, 0],"
-"  [571, -0.100,  0.527,  0.000, 0],"
-"  [572, -0.100,  0.526,  0.000, 0],"
-"  [573, -0.100,  0.526,  0.000, 0],"
-"  [574, -0.100,  0.526,  0.000, 0],"
-"  [575, -0.100,  0.525,  0.000, 0],"
-"  [576, -0.100,  0.525,  0.000, 0],"
-"  [577, -0.100,  0.525,  0.000, 0],"
-"  [578, -0.100,  0.525,  0.000, 0],"
-"  [579, -0.100,  0.524,  0.000, 0],"
-"  [580, -0.100,  0.524,  0.000, 0],"
-"  [581, -0.100,  0.524,  0.000, 0],"
-"  [582, -0.100,  0.523,  0.000, 0],"
-"  [583, -0.100,  0.523,  0.000, 0],"
-"  [584, -0.100,  0.523,  0.000, 0],"
-"  [585, -0.100,  0.523,  0.000, 0],"
-"  [586, -0.100,  0.522,  0.000, 0],"
-"  [587, -0.100,  0.522,  0.000, 0],"
-"  [588, -0.100,  0.522,  0.000, 0],"
-"  [589, -0.100,  0.522,  0.000, 0],"
-"  [590, -0.100,  0.521,  0.000, 0],"
-"  [591, -0.100,  0.521,  0.000, 0],"
-"  [592, -0.100,  0.521,  0.000, 0],"
-"  [593, -0.100,  0.520,  0.000, 0],"
-"  [594, -0.100,  0.520,  0.000, 0],"
-"  [595, -0.100,  0.520,  0.000, 0],"
-"  [596, -0.100,  0.520,  0.000, 0],"
-"  [597, -0.100,  0.519,  0.000, 0],"
-"  [598, -0.100,  0.519,  0.000, 0],"
-"  [599, -0.100,  0.519,  0.000, 0],"
-"  [600, -0.100,  0.533,  0.000, 0],"
-"  [601, -0.100,  0.547,  0.000, 0],"
-"  [602, -0.100,  0.547,  0.000, 0],"
-"  [603, -0.100,  0.547,  0.000, 0],"
-"  [604, -0.100,  0.547,  0.000, 0],"
-"  [605, -0.100,  0.546,  0.000, 0],"
-"  [606, -0.100,  0.546,  0.000, 0],"
-"  [607, -0.100,  0.546,  0.000, 0],"
-"  [608, -0.100,  0.546,  0.000, 0],"
-"  [609, -0.100,  0.546,  0.000, 0],"
-"  [610, -0.100,  0.545,  0.000, 0],"
-"  [611, -0.100,  0.545,  0.000, 0],"
-"  [612, -0.100,  0.545,  0.000, 0],"
-"  [613, -0.100,  0.545,  0.000, 0],"
-"  [614, -0.100,  0.544,  0.000, 0],"
-"  [615, -0.100,  0.544,  0.000, 0],"
-"  [616, -0.100,  0.544,  0.000, 0],"
-"  [617, -0.100,  0.544,  0.000, 0],"
-"  [618, -0.100,  0.544,  0.000, 0],"
-"  [619, -0.100,  0.543,  0.000, 0],"
-"  [620, -0.100,  0.543,  0.000, 0],"
-"  [621, -0.100,  0.543,  0.000, 0],"
-"  [622, -0.100,  0.543,  0.000, 0],"
-"  [623, -0.100,  0.543,  0.000, 0],"
-"  [624, -0.100,  0.542,  0.000, 0],"
-"  [625, -0.100,  0.542,  0.000, 0],"
-"  [626, -0.100,  0.542,  0.000, 0],"
-"  [627, -0.100,  0.542,  0.000, 0],"
-"  [628, -0.100,  0.542,  0.000, 0],"
-"  [629, -0.100,  0.541,  0.000, 0],"
-"  [630, -0.100,  0.554,  0.000, 0],"
-"  [631, -0.100,  0.567,  0.000, 0],"
-"  [632, -0.100,  0.567,  0.000, 0],"
-"  [633, -0.100,  0.567,  0.000, 0],"
-"  [634, -0.100,  0.566,  0.000, 0],"
-"  [635, -0.100,  0.566,  0.000, 0],"
-"  [636, -0.100,  0.566,  0.000, 0],"
-"  [637, -0.100,  0.566,  0.000, 0],"
-"  [638, -0.100,  0.566,  0.000, 0],"
-"  [639, -0.100,  0.565,  0.000, 0],"
-"  [640, -0.100,  0.565,  0.000, 0],"
-"  [641, -0.100,  0.565,  0.000, 0],"
-"  [642, -0.100,  0.565,  0.000, 0],"
-"  [643, -0.100,  0.565,  0.000, 0],"
-"  [644, -0.100,  0.565,  0.000, 0],"
-"  [645, -0.100,  0.564,  0.000, 0],"
-"  [646, -0.100,  0.564,  0.000, 0],"
-"  [647, -0.100,  0.564,  0.000, 0],"
-"  [648, -0.100,  0.564,  0.000, 0],"
-"  [649, -0.100,  0.564,  0.000, 0],"
-"  [650, -0.100,  0.564,  0.000, 0],"
-"  [651, -0.100,  0.563,  0.000, 0],"
-"  [652, -0.100,  0.563,  0.000, 0],"
-"  [653, -0.100,  0.563,  0.000, 0],"
-"  [654, -0.100,  0.563,  0.000, 0],"
-"  [655, -0.100,  0.563,  0.000, 0],"
-"  [656, -0.100,  0.563,  0.000, 0],"
-"  [657, -0.100,  0.562,  0.000, 0],"
-"  [658, -0.100,  0.562,  0.000, 0],"
-"  [659, -0.100,  0.562,  0.000, 0],"
-"  [660, -0.083,  0.575,  0.000, 0],"
-"  [661, -0.067,  0.589,  0.000, 0],"
-"  [662, -0.067,  0.589,  0.000, 0],"
-"  [663, -0.067,  0.589,  0.000, 0],"
-"  [664, -0.067,  0.589,  0.000, 0],"
-"  [665, -0.067,  0.589,  0.000, 0],"
-"  [666, -0.067,  0.589,  0.000, 0],"
-"  [667, -0.067,  0.589,  0.000, 0],"
-"  [668, -0.067,  0.589,  0.000, 0],"
-"  [669, -0.067,  0.589,  0.000, 0],"
-"  [670, -0.067,  0.589,  0.000, 0],"
-"  [671, -0.067,  0.589,  0.000, 0],"
-"  [672, -0.067,  0.589,  0.000, 0],"
-"  [673, -0.067,  0.589,  0.000, 0],"
-"  [674, -0.067,  0.589,  0.000, 0],"
-"  [675, -0.067,  0.589,  0.000, 0],"
-"  [676, -0.067,  0.589,  0.000, 0],"
-"  [677, -0.067,  0.589,  0.000, 0],"
-"  [678, -0.067,  0.589,  0.000, 0],"
-"  [679, -0.067,  0.590,  0.000, 0],"
-"  [680, -0.067,  0.590,  0.000, 0],"
-"  [681, -0.067,  0.590,  0.000, 0],"
-"  [682, -0.067,  0.590,  0.000, 0],"
-"  [683, -0.067,  0.590,  0.000, 0],"
-"  [684, -0.067,  0.590,  0.000, 0],"
-"  [685, -0.067,  0.590,  0.000, 0],"
-"  [686, -0.067,  0.590,  0.000, 0],"
-"  [687, -0.067,  0.590,  0.000, 0],"
-"  [688, -0.067,  0.590,  0.000, 0],"
-"  [689, -0.067,  0.590,  0.000, 0],"
-"  [690, -0.033,  0.596,  0.000, 0],"
-"  [691,  0.000,  0.603,  0.000, 0],"
-"  [692,  0.000,  0.603,  0.000, 0],"
-"  [693,  0.000,  0.604,  0.000, 0],"
-"  [694,  0.000,  0.604,  0.000, 0],"
-"  [695,  0.000,  0.605,  0.000, 0],"
-"  [696,  0.000,  0.605,  0.000, 0],"
-"  [697,  0.000,  0.605,  0.000, 0],"
-"  [698,  0.000,  0.606,  0.000, 0],"
-"  [699,  0.000,  0.606,  0.000, 0],"
-"  [700,  0.000,  0.607,  0.000, 0],"
-"  [701,  0.000,  0.607,  0.000, 0],"
-"  [702,  0.000,  0.608,  0.000, 0],"
-"  [703,  0.000,  0.608,  0.000, 0],"
-"  [704,  0.000,  0.608,  0.000, 3]"
-"]";
+  if(!data || len < sizeof(profile_header_t))
+    return false;
+  const profile_header_t* header = (const profile_header_t*)data;
+  if(!profile_check(header))
+    return false;
+  if(len - sizeof(profile_header_t) < (uint64_t)header->rows * sizeof(profile_sample_t))
+    return false;
 
+  profile->header  = *header;
+  profile->samples = (const profile_sample_t*)(header + 1);
+  return true;
+}
 
-bool profile_load_file(const uint8_t* data, uint64_t len)
+// Reads a binary image through read(), PROFILE_WINDOW samples at a time, so
+// the length of the profile does not depend on the memory available. close()
+// is called with context by profile_free(), also when this fails.
+bool profile_stream(profile_t* profile, profile_read_t read, profile_close_t close, void* context)
 {
-  // Parse JSON string
-  cJSON *json = cJSON_Parse(test);
-  if(json){
-    printf("success to load profile\n");
-    profile_load_json(json);
-  }else{
-    printf("failed to load profile\n");
+  memset(profile, 0, sizeof(profile_t));
+  profile->read    = read;
+  profile->close   = close;
+  profile->context = context;
+
+  if(!read(context, 0, &profile->header, sizeof(profile_header_t)) || !profile_check(&profile->header))
+  {
+    memset(&profile->header, 0, sizeof(profile_header_t));
     return false;
   }
-  cJSON_Delete(json);
-  return json != NULL;
-}
\ No newline at end of file
+  return true;
+}
+
+uint64_t profile_size(const profile_t* profile)
+{
+  return sizeof(profile_header_t) + (uint64_t)profile->header.rows * sizeof(profile_sample_t);
+}
+
+void profile_free(profile_t* profile)
+{
+  if(profile->close)
+    profile->close(profile->context);
+  free(profile->storage);
+  memset(profile, 0, sizeof(profile_t));
+}
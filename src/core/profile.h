@@ -3,6 +3,32 @@
 
 #include <stdint.h>
 
+// Binary profile image: a profile_header_t followed by header.rows samples,
+// little endian. It is used in place, straight out of XIP flash on the Pico.
+#define PROFILE_MAGIC   0x50434741 // "AGCP"
+#define PROFILE_VERSION 1
+
+// The columns are stored as fixed point with this many units per 1.0; the
+// profiles are written with three decimals so the conversion is exact.
+#define PROFILE_SCALE 1000
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t sample_size;
+  uint32_t rows;
+  uint32_t step_ms;
+} profile_header_t;
+
+typedef struct
+{
+  int32_t rot_y;
+  int32_t accel_x;
+  int32_t rot_x;
+  int32_t stage;
+} profile_sample_t;
+
 typedef struct
 {
   double rot_y;
@@ -11,6 +37,37 @@ typedef struct
   int stage;
 } row_t;
 
-row_t profile_get_data(int seconds);
+// Reads len bytes at offset of a binary image that is not memory mapped.
+typedef bool (*profile_read_t)(void* context, uint64_t offset, void* data, uint32_t len);
+typedef void (*profile_close_t)(void* context);
+
+// Samples of a streamed profile are cached this many at a time.
+#define PROFILE_WINDOW 32
+
+typedef struct
+{
+  profile_header_t        header;
+  const profile_sample_t* samples;
+  void*                   storage;
+
+  // Streamed profiles: samples is NULL and rows are read through a window.
+  profile_read_t   read;
+  profile_close_t  close;
+  void*            context;
+  uint32_t         window_start;
+  uint32_t         window_rows;
+  profile_sample_t window[PROFILE_WINDOW];
+} profile_t;
+
+row_t    profile_get_data(profile_t* profile, uint64_t millis);
+
+bool     profile_map(profile_t* profile, const uint8_t* data, uint64_t len);
+bool     profile_stream(profile_t* profile, profile_read_t read, profile_close_t close, void* context);
+uint64_t profile_size(const profile_t* profile);
+void     profile_free(profile_t* profile);
 
-bool profile_load_file(const uint8_t* data, uint64_t len);
\ No newline at end of file
+// Host only (profile_json.c): accept either a binary image or the JSON
+// source format and keep a private copy of the samples. profile_open()
+// streams binary images from the file instead of loading them.
+bool profile_load_file(profile_t* profile, const uint8_t* data, uint64_t len);
+bool profile_open(profile_t* profile, const char* path);
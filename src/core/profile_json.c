@@ -0,0 +1,143 @@
+#include "profile.h"
+
+#include <cjson/cJSON.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rounds a JSON column to the fixed point representation of the binary format.
+static int32_t profile_fixed(double value)
+{
+  return (int32_t)(value * PROFILE_SCALE + (value < 0 ? -0.5 : 0.5));
+}
+
+// Longest profile read from JSON: one day, at one row per second.
+#define PROFILE_JSON_ROWS 86400
+
+// Checks that a row of the JSON source is [second, rot_y, accel_x, rot_x,
+// stage], all numbers, with a second below PROFILE_JSON_ROWS.
+static bool profile_json_row_ok(const cJSON* row)
+{
+  if(!cJSON_IsArray(row) || cJSON_GetArraySize(row) < 5)
+    return false;
+  for(int i = 0; i < 5; i++)
+    if(!cJSON_IsNumber(cJSON_GetArrayItem(row, i)))
+      return false;
+  double second = cJSON_GetArrayItem(row, 0)->valuedouble;
+  return second >= 0 && second < PROFILE_JSON_ROWS;
+}
+
+// Converts the JSON source format, an array of
+// [second, rot_y, accel_x, rot_x, stage] rows, into a binary image with a one
+// second step. Seconds that are missing from the source read as zeros; a row
+// that is not of that form fails the whole profile.
+static bool profile_load_json(profile_t* profile, cJSON* json)
+{
+  uint32_t rows = 0;
+  cJSON*   row  = NULL;
+  cJSON_ArrayForEach(row, json)
+  {
+    if(!profile_json_row_ok(row))
+      return false;
+    uint32_t idx = cJSON_GetArrayItem(row, 0)->valueint;
+    if(idx >= rows)
+      rows = idx + 1;
+  }
+
+  uint64_t size = sizeof(profile_header_t) + (uint64_t)rows * sizeof(profile_sample_t);
+  uint8_t* image = calloc(1, size);
+  if(!image)
+    return false;
+
+  profile_header_t* header  = (profile_header_t*)image;
+  profile_sample_t* samples = (profile_sample_t*)(header + 1);
+  header->magic       = PROFILE_MAGIC;
+  header->version     = PROFILE_VERSION;
+  header->sample_size = sizeof(profile_sample_t);
+  header->rows        = rows;
+  header->step_ms     = 1000;
+
+  cJSON_ArrayForEach(row, json)
+  {
+    profile_sample_t* sample = &samples[cJSON_GetArrayItem(row, 0)->valueint];
+    sample->rot_y   = profile_fixed(cJSON_GetArrayItem(row, 1)->valuedouble);
+    sample->accel_x = profile_fixed(cJSON_GetArrayItem(row, 2)->valuedouble);
+    sample->rot_x   = profile_fixed(cJSON_GetArrayItem(row, 3)->valuedouble);
+    sample->stage   = cJSON_GetArrayItem(row, 4)->valueint;
+  }
+
+  profile_map(profile, image, size);
+  profile->storage = image;
+  return true;
+}
+
+static bool profile_load_string(profile_t* profile, const char* data, size_t len)
+{
+  memset(profile, 0, sizeof(profile_t));
+
+  cJSON* json = cJSON_ParseWithLength(data, len);
+  if(!json)
+    return false;
+
+  bool loaded = cJSON_IsArray(json) && profile_load_json(profile, json);
+  cJSON_Delete(json);
+  return loaded;
+}
+
+bool profile_load_file(profile_t* profile, const uint8_t* data, uint64_t len)
+{
+  profile_t mapped;
+  if(!profile_map(&mapped, data, len))
+    return profile_load_string(profile, (const char*)data, len);
+
+  uint64_t size  = profile_size(&mapped);
+  uint8_t* image = malloc(size);
+  if(!image)
+    return false;
+  memcpy(image, data, size);
+  profile_map(profile, image, size);
+  profile->storage = image;
+  return true;
+}
+
+static bool profile_read_file(void* context, uint64_t offset, void* data, uint32_t len)
+{
+  FILE* file = context;
+  return fseek(file, (long)offset, SEEK_SET) == 0 && fread(data, 1, len, file) == len;
+}
+
+static void profile_close_file(void* context)
+{
+  fclose(context);
+}
+
+bool profile_open(profile_t* profile, const char* path)
+{
+  memset(profile, 0, sizeof(profile_t));
+
+  FILE* file = fopen(path, "rb");
+  if(!file)
+    return false;
+
+  if(profile_stream(profile, profile_read_file, profile_close_file, file))
+    return true;
+  profile_free(profile);
+
+  // Not a binary image, parse it as JSON instead.
+  file = fopen(path, "rb");
+  if(!file)
+    return false;
+  fseek(file, 0, SEEK_END);
+  long len = ftell(file);
+  rewind(file);
+
+  char* data   = malloc(len > 0 ? len : 1);
+  bool  loaded = data && fread(data, 1, len, file) == (size_t)len &&
+                 profile_load_string(profile, data, len);
+  free(data);
+  fclose(file);
+  return loaded;
+}
+
@@ -24,46 +24,79 @@
 
 #include <core/ringbuffer.h>
 
-#include <string.h>
-
-ringbuffer ringbuffer_in;
-ringbuffer ringbuffer_out;
 
 /*
  * Initialize the ringbuffer; make it empty.
  */
 void ringbuffer_init(ringbuffer* buf)
 {
-  buf->tail = buf->head = 0;
+  atomic_store_explicit(&buf->tail, 0, memory_order_relaxed);
+  atomic_store_explicit(&buf->head, 0, memory_order_relaxed);
 }
 
-/* Copies `element` into the ringbuffer. Returns the number of copied bytes.
- * If the ringbuffer is full, does nothing and returns 0.
+/* Copies up to `n` packets into the ringbuffer and returns how many were
+ * copied, which is less than `n` when the ringbuffer fills up.
+ * Only the producer may call this.
  */
-int ringbuffer_put(ringbuffer* buf, unsigned char* element)
+int ringbuffer_put_n(ringbuffer* buf, const packet_t* packets, int n)
 {
-  int i = (buf->head + RINGBUFFER_ELEMENT_SIZE) & (RINGBUFFER_CAPACITY - 1);
-  if(i == buf->tail)
-    return 0; // full
+  int head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+  int tail = atomic_load_explicit(&buf->tail, memory_order_acquire);
+  int room = (tail - head - 1) & RINGBUFFER_MASK;
 
-  memcpy(buf->data + buf->head, element, RINGBUFFER_ELEMENT_SIZE);
-  buf->head = i;
+  if(n > room)
+    n = room;
+  for(int i = 0; i < n; i++)
+    buf->data[(head + i) & RINGBUFFER_MASK] = packets[i];
+  atomic_store_explicit(&buf->head, (head + n) & RINGBUFFER_MASK, memory_order_release);
 
-  return RINGBUFFER_ELEMENT_SIZE;
+  return n;
 }
 
-/* Copies the next entry from `buf` into `element` and returns the number
- * of copied bytes.
- * If the ringbuffer is empty, does nothing and returns 0.
+/* Copies up to `n` of the oldest packets from `buf` into `packets`, removes
+ * them from the ringbuffer and returns how many were copied.
+ * Only the consumer may call this.
  */
-int ringbuffer_get(ringbuffer* buf, unsigned char* element)
+int ringbuffer_get_n(ringbuffer* buf, packet_t* packets, int n)
 {
-  if(buf->tail == buf->head)
-    return 0; // empty
+  int tail  = atomic_load_explicit(&buf->tail, memory_order_relaxed);
+  int head  = atomic_load_explicit(&buf->head, memory_order_acquire);
+  int count = (head - tail) & RINGBUFFER_MASK;
+
+  if(n > count)
+    n = count;
+  for(int i = 0; i < n; i++)
+    packets[i] = buf->data[(tail + i) & RINGBUFFER_MASK];
+  atomic_store_explicit(&buf->tail, (tail + n) & RINGBUFFER_MASK, memory_order_release);
+
+  return n;
+}
+
+/* Copies `packet` into the ringbuffer. Returns 1, or 0 if the ringbuffer is
+ * full.
+ */
+int ringbuffer_put(ringbuffer* buf, const packet_t* packet)
+{
+  return ringbuffer_put_n(buf, packet, 1);
+}
+
+/* Moves the oldest packet of `buf` into `packet`. Returns 1, or 0 if the
+ * ringbuffer is empty.
+ */
+int ringbuffer_get(ringbuffer* buf, packet_t* packet)
+{
+  return ringbuffer_get_n(buf, packet, 1);
+}
 
-  memcpy(element, buf->data + buf->tail, RINGBUFFER_ELEMENT_SIZE);
-  buf->tail =
-    (buf->tail + RINGBUFFER_ELEMENT_SIZE) & (RINGBUFFER_CAPACITY - 1);
+/* Like ringbuffer_get(), but leaves the packet in the ringbuffer.
+ * Only the consumer may call this.
+ */
+int ringbuffer_peek(ringbuffer* buf, packet_t* packet)
+{
+  int tail = atomic_load_explicit(&buf->tail, memory_order_relaxed);
+  if(tail == atomic_load_explicit(&buf->head, memory_order_acquire))
+    return 0; // empty
 
-  return RINGBUFFER_ELEMENT_SIZE;
+  *packet = buf->data[tail];
+  return 1;
 }
@@ -25,19 +25,11 @@
 
 #pragma once
 
+#include <stdatomic.h>
 #include <stdint.h>
 
-#define RINGBUFFER_ELEMENT_SIZE 4
 #define RINGBUFFER_ELEMENTS 1024
-#define RINGBUFFER_CAPACITY \
-  RINGBUFFER_ELEMENTS* RINGBUFFER_ELEMENT_SIZE
-
-typedef struct
-{
-  unsigned char data[RINGBUFFER_CAPACITY];
-  int           tail;
-  int           head;
-} ringbuffer;
+#define RINGBUFFER_MASK (RINGBUFFER_ELEMENTS - 1)
 
 typedef struct
 {
@@ -45,9 +37,42 @@ typedef struct
   uint16_t value;
 } packet_t;
 
-extern ringbuffer ringbuffer_in;
-extern ringbuffer ringbuffer_out;
+/*
+ * A single-producer/single-consumer queue. One thread (or Pico core) may put
+ * while another one gets: head is only written by the producer and tail only
+ * by the consumer, and the release/acquire pairs on them order the element
+ * copies against the index updates. One slot is kept free to tell a full
+ * ring from an empty one.
+ */
+typedef struct
+{
+  packet_t   data[RINGBUFFER_ELEMENTS];
+  atomic_int tail;
+  atomic_int head;
+} ringbuffer;
+
+/*
+ * Unordered reads of the indices, for polling whether anything was put or
+ * taken. Use ringbuffer_get() to actually read the elements.
+ */
+static inline int ringbuffer_head(ringbuffer* buf)
+{
+  return atomic_load_explicit(&buf->head, memory_order_relaxed);
+}
+
+static inline int ringbuffer_tail(ringbuffer* buf)
+{
+  return atomic_load_explicit(&buf->tail, memory_order_relaxed);
+}
+
+static inline int ringbuffer_empty(ringbuffer* buf)
+{
+  return ringbuffer_head(buf) == ringbuffer_tail(buf);
+}
 
 void ringbuffer_init(ringbuffer* buf);
-int  ringbuffer_put(ringbuffer* buf, unsigned char* Packet);
-int  ringbuffer_get(ringbuffer* buf, unsigned char* Packet);
+int  ringbuffer_put(ringbuffer* buf, const packet_t* packet);
+int  ringbuffer_get(ringbuffer* buf, packet_t* packet);
+int  ringbuffer_put_n(ringbuffer* buf, const packet_t* packets, int n);
+int  ringbuffer_get_n(ringbuffer* buf, packet_t* packets, int n);
+int  ringbuffer_peek(ringbuffer* buf, packet_t* packet);
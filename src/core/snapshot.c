@@ -0,0 +1,524 @@
+#include "snapshot.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// CRC-32 (IEEE), half a byte at a time to keep the table small.
+static const uint32_t crc32_table[16] = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t snapshot_crc32(uint32_t crc, const void* data, uint64_t len)
+{
+  const uint8_t* p = data;
+
+  crc = ~crc;
+  while(len--)
+  {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ crc32_table[crc & 15];
+    crc = (crc >> 4) ^ crc32_table[crc & 15];
+  }
+  return ~crc;
+}
+
+//-------------------------------------------------------------------------------
+// Saving. The state is serialized twice: once without a write function, to
+// learn the size and checksum that go into the header, and once for real.
+
+typedef struct
+{
+  snapshot_write_t write;
+  void*            context;
+  bool             ok;
+  uint32_t         size;
+  uint32_t         crc;
+  uint32_t         fill;
+  uint8_t          chunk[64];
+} writer_t;
+
+static void put_flush(writer_t* w)
+{
+  w->crc = snapshot_crc32(w->crc, w->chunk, w->fill);
+  w->size += w->fill;
+  if(w->write && w->ok && w->fill)
+    w->ok = w->write(w->context, w->chunk, w->fill);
+  w->fill = 0;
+}
+
+static void put_u8(writer_t* w, uint8_t value)
+{
+  w->chunk[w->fill++] = value;
+  if(w->fill == sizeof(w->chunk))
+    put_flush(w);
+}
+
+static void put_u16(writer_t* w, uint16_t value)
+{
+  put_u8(w, value);
+  put_u8(w, value >> 8);
+}
+
+static void put_u32(writer_t* w, uint32_t value)
+{
+  put_u16(w, value);
+  put_u16(w, value >> 16);
+}
+
+static void put_u64(writer_t* w, uint64_t value)
+{
+  put_u32(w, value);
+  put_u32(w, value >> 32);
+}
+
+static void put_words(writer_t* w, const int16_t* words, int n)
+{
+  for(int i = 0; i < n; i++)
+    put_u16(w, words[i]);
+}
+
+static uint32_t cpu_flags(const agc_state_t* state)
+{
+  return state->extra_code | state->allow_interrupt << 1 | state->in_isr << 2 |
+         state->substitute_instruction << 3 | state->pend_flag << 4 | state->downrupt_time_valid << 5 |
+         state->night_watchman << 6 | state->night_watchman_tripped << 7 | state->rupt_lock << 8 |
+         state->no_rupt << 9 | state->tc_trap << 10 | state->no_tc << 11 | state->standby << 12 |
+         state->sby_pressed << 13 | state->sby_still_pressed << 14 | state->parity_fail << 15 |
+         state->restart_light << 16 | state->took_bzf << 17 | state->took_bzmf << 18 |
+         state->generated_warning << 19 | state->trap_31a << 20 | state->trap_31b << 21 |
+         (uint32_t)state->trap_32 << 22;
+}
+
+static void put_state(writer_t* w, const agc_state_t* state)
+{
+  // Erasable memory comes first, for snapshot_load_erasable().
+  put_words(w, &state->erasable[0][0], 8 * 0400);
+  put_words(w, state->input_channel, NUM_CHANNELS);
+
+  put_u64(w, state->cycle_counter);
+  put_u16(w, state->output_channel_7);
+  put_words(w, state->output_channel_10, 16);
+  put_u16(w, state->index_value);
+  for(int i = 0; i < 1 + NUM_INTERRUPT_TYPES; i++)
+    put_u8(w, state->interrupt_requests[i]);
+  put_u32(w, cpu_flags(state));
+  put_u8(w, state->pend_delay);
+  put_u8(w, state->extra_delay);
+  put_u8(w, state->radar_gate_counter);
+  put_u32(w, state->warning_filter);
+  put_u64(w, state->downrupt_time);
+  put_u32(w, state->downlink);
+  put_u32(w, state->next_z);
+  put_u32(w, state->scale_counter);
+  put_u64(w, state->channel_routine_time);
+  put_u64(w, state->next_event);
+  put_u32(w, state->dsky_timer);
+  put_u32(w, state->dsky_flash);
+  put_u16(w, state->dsky_channel_163);
+
+  for(int i = 0; i < NUM_CDU_FIFOS; i++)
+  {
+    const cdu_fifo_t* fifo = &state->cdu_fifos[i];
+    put_u32(w, fifo->idx);
+    put_u32(w, fifo->size);
+    put_u32(w, fifo->interval_type);
+    put_u64(w, fifo->next_update);
+    for(int j = 0; j < fifo->size; j++)
+      put_u32(w, fifo->counts[j]);
+  }
+  put_u32(w, state->cdu_checker);
+  put_u64(w, state->cdu_due);
+
+  put_u32(w, state->gyro_count);
+  put_u32(w, state->gyro_timer);
+  put_u32(w, state->old_channel_14);
+  put_u64(w, state->imu_cdu_count);
+  put_u32(w, state->imu_channel_14);
+  put_u32(w, state->count_cdu_x);
+  put_u32(w, state->count_cdu_y);
+  put_u32(w, state->count_cdu_z);
+  put_u16(w, state->last_rhc_pitch);
+  put_u16(w, state->last_rhc_yaw);
+  put_u16(w, state->last_rhc_roll);
+
+  for(int i = 0; i < NUM_OUTPUT_SLOTS; i++)
+    put_u16(w, state->output_shadow[i]);
+  put_u32(w, state->output_valid);
+  put_u32(w, state->output_drops);
+  put_u32(w, state->output_high_water);
+}
+
+static void put_dsky(writer_t* w, const dsky_t* dsky)
+{
+  const dsky_indicator_t* ind = &dsky->indicator;
+  put_u16(w, ind->vel | ind->no_att << 1 | ind->alt << 2 | ind->gimbal_lock << 3 | ind->restart << 4 |
+               ind->tracker << 5 | ind->prog << 6 | ind->comp_acty << 7 | ind->uplink_acty << 8 |
+               ind->temp << 9 | ind->key_rel << 10 | ind->opr_err << 11 | ind->stby << 12);
+
+  const dsky_two_t* twos[] = {&dsky->prog, &dsky->verb, &dsky->noun};
+  for(int i = 0; i < 3; i++)
+  {
+    put_u8(w, twos[i]->first);
+    put_u8(w, twos[i]->second);
+  }
+  for(int i = 0; i < 3; i++)
+  {
+    const dsky_row_t* row = &dsky->rows[i];
+    put_u8(w, row->plus | row->minus << 1);
+    put_u8(w, row->first);
+    put_u8(w, row->second);
+    put_u8(w, row->third);
+    put_u8(w, row->fourth);
+    put_u8(w, row->fifth);
+  }
+  put_u8(w, dsky->blink_off);
+}
+
+static void put_flight(writer_t* w, const flight_t* flight)
+{
+  put_u16(w, flight->modestate);
+  put_u64(w, flight->init_time);
+  put_u64(w, flight->start_time);
+  put_u64(w, flight->next_flight_update);
+  put_u64(w, flight->current_time);
+  put_u64(w, flight->real_start_time);
+  put_u64(w, flight->real_current_time);
+  put_u16(w, flight->last_time);
+
+  const imu_t* imu = &flight->imu;
+  for(int i = 0; i < 4; i++)
+    put_u64(w, imu->q[i]);
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      put_u64(w, imu->m[i][j]);
+  for(int i = 0; i < 3; i++)
+  {
+    put_u64(w, imu->angle[i]);
+    put_u64(w, imu->fed[i]);
+    put_u64(w, imu->velocity[i]);
+    put_u64(w, imu->pipa[i]);
+  }
+}
+
+static void put_body(writer_t* w, const agc_state_t* state, const dsky_t* dsky, const flight_t* flight)
+{
+  put_state(w, state);
+  if(dsky)
+    put_dsky(w, dsky);
+  if(flight)
+    put_flight(w, flight);
+  put_flush(w);
+}
+
+uint32_t snapshot_save(const agc_state_t* state, const dsky_t* dsky, const flight_t* flight,
+  snapshot_write_t write, void* context)
+{
+  writer_t w = {0};
+  put_body(&w, state, dsky, flight);
+
+  snapshot_header_t header = {0};
+  header.magic   = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.flags   = (dsky ? SNAPSHOT_DSKY : 0) | (flight ? SNAPSHOT_FLIGHT : 0);
+  header.size    = w.size;
+  header.crc     = w.crc;
+  header.rom_crc = state->rom_crc;
+
+  // The header goes through the same little endian writer as the body.
+  writer_t h = {.write = write, .context = context, .ok = true};
+  put_u32(&h, header.magic);
+  put_u16(&h, header.version);
+  put_u16(&h, header.flags);
+  put_u32(&h, header.size);
+  put_u32(&h, header.crc);
+  put_u32(&h, header.rom_crc);
+  put_flush(&h);
+
+  w = (writer_t){.write = write, .context = context, .ok = h.ok};
+  put_body(&w, state, dsky, flight);
+  return w.ok ? h.size + w.size : 0;
+}
+
+//-------------------------------------------------------------------------------
+// Loading. The header and checksum are checked before the state is touched.
+
+typedef struct
+{
+  const uint8_t* data;
+  uint32_t       pos;
+  uint32_t       size;
+  bool           ok;
+} reader_t;
+
+static uint8_t get_u8(reader_t* r)
+{
+  if(r->pos >= r->size)
+  {
+    r->ok = false;
+    return 0;
+  }
+  return r->data[r->pos++];
+}
+
+static uint16_t get_u16(reader_t* r)
+{
+  uint16_t low = get_u8(r);
+  return low | get_u8(r) << 8;
+}
+
+static uint32_t get_u32(reader_t* r)
+{
+  uint32_t low = get_u16(r);
+  return low | (uint32_t)get_u16(r) << 16;
+}
+
+static uint64_t get_u64(reader_t* r)
+{
+  uint64_t low = get_u32(r);
+  return low | (uint64_t)get_u32(r) << 32;
+}
+
+static void get_words(reader_t* r, int16_t* words, int n)
+{
+  for(int i = 0; i < n; i++)
+    words[i] = get_u16(r);
+}
+
+static int snapshot_open(reader_t* r, snapshot_header_t* header, uint32_t rom_crc, const uint8_t* data,
+  uint64_t len)
+{
+  *r = (reader_t){.data = data, .size = len < sizeof(snapshot_header_t) ? len : sizeof(snapshot_header_t), .ok = true};
+  header->magic   = get_u32(r);
+  header->version = get_u16(r);
+  header->flags   = get_u16(r);
+  header->size    = get_u32(r);
+  header->crc     = get_u32(r);
+  header->rom_crc = get_u32(r);
+
+  if(!r->ok || header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION)
+    return SNAPSHOT_E_FORMAT;
+  if(len - sizeof(snapshot_header_t) < header->size ||
+     snapshot_crc32(0, data + sizeof(snapshot_header_t), header->size) != header->crc)
+    return SNAPSHOT_E_CHECKSUM;
+  if(header->rom_crc != rom_crc)
+    return SNAPSHOT_E_ROM;
+
+  *r = (reader_t){.data = data + sizeof(snapshot_header_t), .size = header->size, .ok = true};
+  return SNAPSHOT_E_OK;
+}
+
+int snapshot_check(const uint8_t* data, uint64_t len, uint32_t rom_crc)
+{
+  reader_t          r;
+  snapshot_header_t header;
+  return snapshot_open(&r, &header, rom_crc, data, len);
+}
+
+static void set_cpu_flags(agc_state_t* state, uint32_t flags)
+{
+  state->extra_code             = flags;
+  state->allow_interrupt        = flags >> 1;
+  state->in_isr                 = flags >> 2;
+  state->substitute_instruction = flags >> 3;
+  state->pend_flag              = flags >> 4;
+  state->downrupt_time_valid    = flags >> 5;
+  state->night_watchman         = flags >> 6;
+  state->night_watchman_tripped = flags >> 7;
+  state->rupt_lock              = flags >> 8;
+  state->no_rupt                = flags >> 9;
+  state->tc_trap                = flags >> 10;
+  state->no_tc                  = flags >> 11;
+  state->standby                = flags >> 12;
+  state->sby_pressed            = flags >> 13;
+  state->sby_still_pressed      = flags >> 14;
+  state->parity_fail            = flags >> 15;
+  state->restart_light          = flags >> 16;
+  state->took_bzf               = flags >> 17;
+  state->took_bzmf              = flags >> 18;
+  state->generated_warning      = flags >> 19;
+  state->trap_31a               = flags >> 20;
+  state->trap_31b               = flags >> 21;
+  state->trap_32                = flags >> 22;
+}
+
+static void get_state(reader_t* r, agc_state_t* state)
+{
+  get_words(r, &state->erasable[0][0], 8 * 0400);
+  get_words(r, state->input_channel, NUM_CHANNELS);
+  state->erasable_dirty = ~0ull;
+
+  state->cycle_counter    = get_u64(r);
+  state->output_channel_7 = get_u16(r);
+  get_words(r, state->output_channel_10, 16);
+  state->index_value = get_u16(r);
+  for(int i = 0; i < 1 + NUM_INTERRUPT_TYPES; i++)
+    state->interrupt_requests[i] = get_u8(r);
+  set_cpu_flags(state, get_u32(r));
+  state->pend_delay           = get_u8(r);
+  state->extra_delay          = get_u8(r);
+  state->radar_gate_counter   = get_u8(r);
+  state->warning_filter       = get_u32(r);
+  state->downrupt_time        = get_u64(r);
+  state->downlink             = get_u32(r);
+  state->next_z               = get_u32(r);
+  state->scale_counter        = get_u32(r);
+  state->channel_routine_time = get_u64(r);
+  state->next_event           = get_u64(r);
+  state->dsky_timer           = get_u32(r);
+  state->dsky_flash           = get_u32(r);
+  state->dsky_channel_163     = get_u16(r);
+
+  for(int i = 0; i < NUM_CDU_FIFOS; i++)
+  {
+    cdu_fifo_t* fifo = &state->cdu_fifos[i];
+    fifo->idx           = get_u32(r);
+    fifo->size          = get_u32(r);
+    fifo->interval_type = get_u32(r);
+    fifo->next_update   = get_u64(r);
+    if(fifo->size < 0 || fifo->size > MAX_CDU_FIFO_ENTRIES)
+    {
+      fifo->size = 0;
+      r->ok      = false;
+    }
+    for(int j = 0; j < fifo->size; j++)
+      fifo->counts[j] = get_u32(r);
+  }
+  state->cdu_checker = get_u32(r);
+  state->cdu_due     = get_u64(r);
+
+  state->gyro_count     = get_u32(r);
+  state->gyro_timer     = get_u32(r);
+  state->old_channel_14 = get_u32(r);
+  state->imu_cdu_count  = get_u64(r);
+  state->imu_channel_14 = get_u32(r);
+  state->count_cdu_x    = get_u32(r);
+  state->count_cdu_y    = get_u32(r);
+  state->count_cdu_z    = get_u32(r);
+  state->last_rhc_pitch = get_u16(r);
+  state->last_rhc_yaw   = get_u16(r);
+  state->last_rhc_roll  = get_u16(r);
+
+  for(int i = 0; i < NUM_OUTPUT_SLOTS; i++)
+    state->output_shadow[i] = get_u16(r);
+  state->output_valid      = get_u32(r);
+  state->output_drops      = get_u32(r);
+  state->output_high_water = get_u32(r);
+
+  // What is not saved starts over: the channel traffic that was queued, the
+  // idle loop detection, and the DSKY and coalesced outputs, which are all
+  // sent again.
+  ringbuffer_init(&state->ringbuffer_in);
+  ringbuffer_init(&state->ringbuffer_out);
+  state->output_dirty = state->output_valid;
+  state->dsky_dirty   = 1;
+  state->idle.stage   = IDLE_SEARCHING;
+  state->idle.count   = IDLE_MAX_INSTRUCTIONS;
+}
+
+static void get_dsky(reader_t* r, dsky_t* dsky)
+{
+  dsky_indicator_t* ind = &dsky->indicator;
+  uint16_t          bits = get_u16(r);
+  ind->vel         = bits;
+  ind->no_att      = bits >> 1;
+  ind->alt         = bits >> 2;
+  ind->gimbal_lock = bits >> 3;
+  ind->restart     = bits >> 4;
+  ind->tracker     = bits >> 5;
+  ind->prog        = bits >> 6;
+  ind->comp_acty   = bits >> 7;
+  ind->uplink_acty = bits >> 8;
+  ind->temp        = bits >> 9;
+  ind->key_rel     = bits >> 10;
+  ind->opr_err     = bits >> 11;
+  ind->stby        = bits >> 12;
+
+  dsky_two_t* twos[] = {&dsky->prog, &dsky->verb, &dsky->noun};
+  for(int i = 0; i < 3; i++)
+  {
+    twos[i]->first  = get_u8(r);
+    twos[i]->second = get_u8(r);
+  }
+  for(int i = 0; i < 3; i++)
+  {
+    dsky_row_t* row  = &dsky->rows[i];
+    uint8_t     sign = get_u8(r);
+    row->plus   = sign;
+    row->minus  = sign >> 1;
+    row->first  = get_u8(r);
+    row->second = get_u8(r);
+    row->third  = get_u8(r);
+    row->fourth = get_u8(r);
+    row->fifth  = get_u8(r);
+  }
+  dsky->blink_off = get_u8(r);
+}
+
+static void get_flight(reader_t* r, flight_t* flight)
+{
+  flight->modestate          = get_u16(r);
+  flight->init_time          = get_u64(r);
+  flight->start_time         = get_u64(r);
+  flight->next_flight_update = get_u64(r);
+  flight->current_time       = get_u64(r);
+  flight->real_start_time    = get_u64(r);
+  flight->real_current_time  = get_u64(r);
+  flight->last_time          = get_u16(r);
+
+  imu_t* imu = &flight->imu;
+  for(int i = 0; i < 4; i++)
+    imu->q[i] = get_u64(r);
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      imu->m[i][j] = get_u64(r);
+  for(int i = 0; i < 3; i++)
+  {
+    imu->angle[i]    = get_u64(r);
+    imu->fed[i]      = get_u64(r);
+    imu->velocity[i] = get_u64(r);
+    imu->pipa[i]     = get_u64(r);
+  }
+}
+
+int snapshot_load(agc_state_t* state, dsky_t* dsky, flight_t* flight, const uint8_t* data, uint64_t len)
+{
+  reader_t          r;
+  snapshot_header_t header;
+  int               ret = snapshot_open(&r, &header, state->rom_crc, data, len);
+  if(ret)
+    return ret;
+
+  get_state(&r, state);
+  // A section that is not wanted still has to be read past.
+  dsky_t   no_dsky;
+  flight_t no_flight;
+  if(header.flags & SNAPSHOT_DSKY)
+    get_dsky(&r, dsky ? dsky : &no_dsky);
+  if(header.flags & SNAPSHOT_FLIGHT)
+    get_flight(&r, flight ? flight : &no_flight);
+
+  return r.ok ? SNAPSHOT_E_OK : SNAPSHOT_E_FORMAT;
+}
+
+int snapshot_load_erasable(agc_state_t* state, const uint8_t* data, uint64_t len)
+{
+  reader_t          r;
+  snapshot_header_t header;
+  int               ret = snapshot_open(&r, &header, state->rom_crc, data, len);
+  if(ret)
+    return ret;
+  if(header.size < 8 * 0400 * 2)
+    return SNAPSHOT_E_FORMAT;
+
+  for(int bank = 0; bank < 8; bank++)
+    for(int j = 0; j < 0400; j++)
+    {
+      int16_t value = get_u16(&r);
+      if(bank > 0 || j >= 010)
+        state->erasable[bank][j] = value;
+    }
+  state->erasable_dirty = ~0ull;
+  return SNAPSHOT_E_OK;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdbool.h>
+
+#include <stdint.h>
+
+#include "agc_engine.h"
+#include "dsky.h"
+
+// Binary snapshot of a running machine: a snapshot_header_t followed by
+// header.size bytes of state, little endian. Everything is written field by
+// field, so a snapshot does not depend on the compiler's struct layout and
+// can be moved between agc_native and agc_pico. Fixed memory is not part of
+// it; rom_crc ties a snapshot to the ROM it was taken with.
+#define SNAPSHOT_MAGIC   0x53434741 // "AGCS"
+#define SNAPSHOT_VERSION 1
+
+// Optional sections in header.flags.
+#define SNAPSHOT_DSKY   0x0001
+#define SNAPSHOT_FLIGHT 0x0002
+
+#define SNAPSHOT_E_OK       0
+#define SNAPSHOT_E_FORMAT   1 // Not a snapshot, or not of this version.
+#define SNAPSHOT_E_CHECKSUM 2 // Truncated or corrupted.
+#define SNAPSHOT_E_ROM      3 // Taken with a different ROM.
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t flags;
+  uint32_t size;    // Bytes of state after the header.
+  uint32_t crc;     // CRC-32 of those bytes.
+  uint32_t rom_crc; // agc_state_t.rom_crc of the machine.
+} snapshot_header_t;
+
+// Appends len bytes to a snapshot being saved.
+typedef bool (*snapshot_write_t)(void* context, const void* data, uint32_t len);
+
+uint32_t snapshot_crc32(uint32_t crc, const void* data, uint64_t len);
+
+// Saves the machine and, unless they are NULL, the DSKY and the flight model.
+// The data is produced in small chunks, so no buffer of the whole snapshot is
+// needed. Returns the size written, 0 on a write error.
+uint32_t snapshot_save(const agc_state_t* state, const dsky_t* dsky, const flight_t* flight,
+  snapshot_write_t write, void* context);
+
+// Checks the header, size and checksum of a snapshot taken with the ROM whose
+// agc_state_t.rom_crc is rom_crc, without restoring it.
+int snapshot_check(const uint8_t* data, uint64_t len, uint32_t rom_crc);
+
+// Restores a snapshot into a machine with the same ROM loaded. dsky and
+// flight are only restored if they are not NULL and the snapshot has them;
+// the profile and the clock of the flight are kept. Channel traffic that was
+// still queued is lost, while the latest value of every coalesced output is
+// sent again.
+int snapshot_load(agc_state_t* state, dsky_t* dsky, flight_t* flight, const uint8_t* data, uint64_t len);
+
+// Restores only the erasable memory of a snapshot, except for the central
+// registers.
+int snapshot_load_erasable(agc_state_t* state, const uint8_t* data, uint64_t len);
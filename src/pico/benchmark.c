@@ -0,0 +1,53 @@
+#include <core/agc_engine.h>
+#include <core/benchmark.h>
+#include <stdio.h>
+
+#include "hardware/clocks.h"
+#include "hardware/vreg.h"
+#include "pico/stdlib.h"
+
+#define BENCHMARK_CYCLES 10000000
+#define AGC_PER_SECOND_F (1024000.0 / 12)
+
+const uint8_t* rom = (const uint8_t*)0x10100000;
+#define ROM_IMAGE_SIZE 0x100000
+
+static agc_state_t   state;
+static int16_t       fixed_fixed[2][02000];
+static agc_decoded_t fixed_fixed_decoded[2][02000];
+
+// Runs the engine flat out on core 0 at the same clock as agc_pico and prints
+// the achieved rate over USB serial, once every few seconds.
+int main(int argc, char* argv[])
+{
+  stdio_init_all();
+
+  vreg_set_voltage(VREG_VOLTAGE_1_25);
+  set_sys_clock_khz(360000, true);
+
+  if(agc_map_rom(&state, rom, ROM_IMAGE_SIZE))
+    agc_load_rom(&state, rom, 73728);
+  agc_cache_rom_banks(&state, 2, 2, fixed_fixed, fixed_fixed_decoded);
+  agc_engine_init(&state, NULL, 0, 0);
+
+  while(true)
+  {
+    uint64_t elapsed_us = agc_benchmark(&state, BENCHMARK_CYCLES);
+    double   seconds    = elapsed_us / 1e6;
+
+    printf(
+      "%s: %u MCT in %.3f s, %.1fx real time\n",
+#ifdef AGC_THREADED_DISPATCH
+      "threaded dispatch",
+#else
+      "switch dispatch",
+#endif
+      BENCHMARK_CYCLES,
+      seconds,
+      BENCHMARK_CYCLES / seconds / AGC_PER_SECOND_F);
+
+    sleep_ms(2000);
+  }
+
+  return (0);
+}
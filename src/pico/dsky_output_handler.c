@@ -3,18 +3,29 @@
 
 #include <core/dsky.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "core/dsky_dump.h"
 #include "core/profile.h"
+#include "core/ringbuffer.h"
 #include "core/us_time.h"
 #include "hardware/clocks.h"
 #include "hardware/vreg.h"
 #include "pico/stdlib.h"
+#include "hardware/sync.h"
 #include "spi.h"
+#include "spi_queue.h"
 
 #define KY_CS_PIN 20
 #define KY_SH_PIN 21
 
+// The shift registers are read every millisecond; a key has to be stable for
+// four reads before it produces an event (see keyboard_debounce()).
+#define KEYBOARD_SCAN_US 1000
+
+// 20 ms of AGC time between keycodes handed to the engine.
+#define KEYSTROKE_CYCLES (1024000 / 12 / 50)
+
 typedef struct __attribute__((packed))
 {
   uint zero : 1;
@@ -42,21 +53,73 @@ typedef struct __attribute__((packed))
   uint key_rel : 1;
 } keyboard_t;
 
-static keyboard_t read_keyboard()
+// Last keyboard state shifted in by the DMA SPI queue.
+static keyboard_t    keyboard_scan;
+static volatile bool keyboard_scan_ready = false;
+
+static void keyboard_scan_begin(spi_transaction_t* transaction)
 {
   gpio_put(KY_SH_PIN, 1);
+}
 
-  keyboard_t result;
-  cs_select(KY_CS_PIN);
-  spi_read_blocking(spi_default, 0, (uint8_t*)&result, 3);
-  cs_deselect(KY_CS_PIN);
-
+static void keyboard_scan_done(spi_transaction_t* transaction)
+{
   gpio_put(KY_SH_PIN, 0);
-  return result;
+  memcpy(&keyboard_scan, transaction->rx, sizeof(keyboard_t));
+  keyboard_scan_ready = true;
+}
+
+// Queues a read of the keyboard shift registers; the result is picked up by
+// take_keyboard() on a later poll.
+static void request_keyboard()
+{
+  spi_transaction_t transaction = {
+    .cs_pin = KY_CS_PIN,
+    .len    = sizeof(keyboard_t),
+    .begin  = keyboard_scan_begin,
+    .done   = keyboard_scan_done};
+  spi_queue_submit(&transaction);
+}
+
+static bool take_keyboard(keyboard_t* result)
+{
+  if(!keyboard_scan_ready)
+    return false;
+
+  uint32_t irq = save_and_disable_interrupts();
+  *result             = keyboard_scan;
+  keyboard_scan_ready = false;
+  restore_interrupts(irq);
+  return true;
+}
+
+// Key presses scanned on core 1, handed over to the engine core by
+// dsky2agc_handle().
+static ringbuffer key_ring;
+
+static void keyboard_press_key(Key key)
+{
+  packet_t packet = {.channel = 015, .value = key};
+  ringbuffer_put(&key_ring, &packet);
+}
+
+static void keyboard_press_pro(bool on)
+{
+  packet_t packet = {.channel = 032, .value = on ? 020000 : 0};
+  ringbuffer_put(&key_ring, &packet);
+}
+
+// Hands key presses to whoever runs before the engine does, such as the
+// program selection at boot.
+bool keyboard_take(packet_t* packet)
+{
+  return ringbuffer_get(&key_ring, packet);
 }
 
 void init_keyboard()
 {
+  ringbuffer_init(&key_ring);
+
   gpio_init(KY_CS_PIN);
   gpio_set_dir(KY_CS_PIN, GPIO_OUT);
   gpio_put(KY_CS_PIN, 0);
@@ -71,127 +134,137 @@ typedef union {
   uint32_t   raw;
 } keyboard_union_t;
 
-keyboard_t to_keys_down(keyboard_t last_keyboard, keyboard_t current_keyboard)
-{
+// Keycode sent on channel 015 for each bit of the scan, 0 for bits that are
+// unused or handled separately (PRO goes to channel 032).
+static const Key keyboard_keys[24] = {
+  KEY_ZERO, KEY_NOUN, KEY_VERB, KEY_MINUS, KEY_FOUR, KEY_FIVE, 0, KEY_ONE,
+  0, KEY_PLUS, KEY_SEVEN, KEY_EIGHT, KEY_NINE, KEY_CLR, 0, 0,
+  KEY_THREE, KEY_TWO, 0, KEY_SIX, 0, KEY_ENTER, KEY_RSET, KEY_KEY_REL};
 
-  keyboard_union_t last_keyboard_union = {.bits = last_keyboard};
-  keyboard_union_t current_keyboard_union = {.bits = current_keyboard};
+#define KEYBOARD_PRO_BIT (1u << 20)
 
-  current_keyboard_union.raw = (~last_keyboard_union.raw) & current_keyboard_union.raw;
-  return current_keyboard_union.bits;
+// Per-key debouncing with a two bit vertical counter: a key changes state only
+// after four consecutive scans disagree with it. Returns the bits that changed
+// state on this scan.
+static uint32_t keyboard_debounce(uint32_t sample)
+{
+  static uint32_t debounced = 0;
+  static uint32_t count0    = 0;
+  static uint32_t count1    = 0;
+
+  uint32_t delta  = sample ^ debounced;
+  count1          = (count1 ^ count0) & delta;
+  count0          = ~count0 & delta;
+  uint32_t toggle = delta & ~(count0 | count1);
+  debounced ^= toggle;
+  return toggle;
 }
 
-void serial2agc_handle()
+int serial2agc_handle(agc_state_t* state)
 {
   int c = getchar_timeout_us(0);
   switch(c)
   {
     case '0':
-      dsky_press_key(KEY_ZERO);
+      dsky_press_key(state, KEY_ZERO);
       break;
     case 'V':
     case 'v':
-      dsky_press_key(KEY_VERB);
+      dsky_press_key(state, KEY_VERB);
       break;
     case 'N':
     case 'n':
-      dsky_press_key(KEY_NOUN);
+      dsky_press_key(state, KEY_NOUN);
       break;
     case 'R':
     case 'r':
-      dsky_press_key(KEY_RSET);
+      dsky_press_key(state, KEY_RSET);
       break;
     case 'K':
     case 'k':
-      dsky_press_key(KEY_KEY_REL);
+      dsky_press_key(state, KEY_KEY_REL);
       break;
     case 'P':
     case 'p':
-      dsky_press_pro(0);
+      dsky_press_pro(state, 0);
       break;
     case 'O':
     case 'o':
-      dsky_press_pro(1);
+      dsky_press_pro(state, 1);
       break;
+    case 'Z':
+    case 'z':
+      return DSKY_REQUEST_REWIND;
     case 'E':
     case 'e':
     case '\n':
-      dsky_press_key(KEY_ENTER);
+      dsky_press_key(state, KEY_ENTER);
       break;
     case -2:
       break;
     default:
       if('1' <= c && c <= '9')
-        dsky_press_key(c - '1' + KEY_ONE);
+        dsky_press_key(state, c - '1' + KEY_ONE);
   }
+  return 0;
 }
 
-void hw2agc_handle()
+void keyboard_poll()
 {
-  static keyboard_t last_keyboard = {0};
   static uint64_t next_time = 0;
 
   uint64_t current_time = time_us_64();
-  if(next_time > current_time) return;
-
-  keyboard_t current_keyboard = read_keyboard();
-  keyboard_t keys_down = to_keys_down(last_keyboard, current_keyboard);
-
-  keyboard_union_t xx;
-  xx.raw = 0;
-  xx.bits = current_keyboard;
-
-  printf("Keys down: %08x\n", xx.raw);
-
-  if(keys_down.entr)
-    dsky_press_key(KEY_ENTER);
-  else if(keys_down.verb)
-    dsky_press_key(KEY_VERB);
-  else if(keys_down.noun)
-    dsky_press_key(KEY_NOUN);
-  else if(keys_down.zero)
-    dsky_press_key(KEY_ZERO);
-  else if(keys_down.one)
-    dsky_press_key(KEY_ONE);
-  else if(keys_down.two)
-    dsky_press_key(KEY_TWO);
-  else if(keys_down.three)
-    dsky_press_key(KEY_THREE);
-  else if(keys_down.four)
-    dsky_press_key(KEY_FOUR);
-  else if(keys_down.five)
-    dsky_press_key(KEY_FIVE);
-  else if(keys_down.six)
-    dsky_press_key(KEY_SIX);
-  else if(keys_down.seven)
-    dsky_press_key(KEY_SEVEN);
-  else if(keys_down.eight)
-    dsky_press_key(KEY_EIGHT);
-  else if(keys_down.nine)
-    dsky_press_key(KEY_NINE);
-  else if(keys_down.rset)
-    dsky_press_key(KEY_RSET);
-  else if(keys_down.key_rel)
-    dsky_press_key(KEY_KEY_REL);
-  else if(keys_down.pro)
-    dsky_press_pro(0);
-  else if(keys_down.clr)
-    dsky_press_key(KEY_CLR);
-  else if(keys_down.plus)
-    dsky_press_key(KEY_PLUS);
-  else if(keys_down.minus)
-    dsky_press_key(KEY_MINUS);
-
-  if(last_keyboard.pro && !current_keyboard.pro)
-    dsky_press_pro(1);
-
-  last_keyboard = current_keyboard;
-  next_time = current_time + 40000;
+  if(next_time <= current_time)
+  {
+    request_keyboard();
+    next_time = current_time + KEYBOARD_SCAN_US;
+  }
+
+  keyboard_union_t scan = {.raw = 0};
+  if(!take_keyboard(&scan.bits))
+    return;
+
+  // Every edge becomes an event, so keys pressed within the same scan are all
+  // queued in bit order instead of only the first one being seen.
+  uint32_t changed = keyboard_debounce(scan.raw & 0xffffff);
+  for(int bit = 0; changed; bit++, changed >>= 1)
+  {
+    if(!(changed & 1))
+      continue;
+
+    bool down = (scan.raw >> bit) & 1;
+    if((1u << bit) == KEYBOARD_PRO_BIT)
+      keyboard_press_pro(!down);
+    else if(down && keyboard_keys[bit])
+      keyboard_press_key(keyboard_keys[bit]);
+  }
 }
 
 
-void dsky2agc_handle()
+int dsky2agc_handle(agc_state_t* state)
 {
-  serial2agc_handle();
-  hw2agc_handle();
+  packet_t packet;
+
+  static uint64_t next_keystroke = 0;
+
+  int requests = serial2agc_handle(state);
+
+  // Keycodes are released no faster than one per KEYSTROKE_CYCLES so that
+  // KEYRUPT1 has read channel 015 before the next one overwrites it.  A
+  // rewind turns the cycle counter back, and the keys must not wait for it
+  // to catch up again.
+  if(next_keystroke > state->cycle_counter + KEYSTROKE_CYCLES)
+    next_keystroke = 0;
+  while(ringbuffer_peek(&key_ring, &packet))
+  {
+    if(packet.channel == 015)
+    {
+      if(state->cycle_counter < next_keystroke)
+        break;
+      next_keystroke = state->cycle_counter + KEYSTROKE_CYCLES;
+    }
+    ringbuffer_get(&key_ring, &packet);
+    dsky_channel_output(state, packet.channel, packet.value);
+  }
+  return requests;
 }
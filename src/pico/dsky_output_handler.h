@@ -1,8 +1,12 @@
 #pragma once
 
-#include "dsky_output_handler.h"
+#include <stdbool.h>
+
+#include "core/ringbuffer.h"
 
 #define KY_CS_PIN 20
 #define KY_SH_PIN 21
 
-void init_keyboard();
\ No newline at end of file
+void init_keyboard();
+bool keyboard_take(packet_t* packet);
+void keyboard_poll();
\ No newline at end of file
@@ -1,27 +1,171 @@
 #include <core/agc_simulator.h>
 
+#include "core/catalog.h"
 #include "core/profile.h"
 #include "core/dsky_dump.h"
+#include "core/snapshot.h"
 #include "hardware/clocks.h"
+#include "hardware/flash.h"
 #include "hardware/vreg.h"
+#include "pico/flash.h"
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "dsky_output_handler.h"
+#include "spi_queue.h"
+
+#include <stdatomic.h>
+#include <string.h>
 
 #include "max7221.c"
 #include "ws2812.c"
 
 
+// bin/catalog.bin, made by agc_catalog and flashed by program.bash: the
+// programs to choose from at boot, each with its ROM, snapshot slot and
+// profile, all used in place.
+const uint8_t *catalog_image = (const uint8_t *)0x10100000;
+#define CATALOG_IMAGE_SIZE 0x300000
+#define CATALOG_FLASH_OFFSET (0x10100000 - XIP_BASE)
+
+// Without a catalog the flash holds a single program: a packed ROM image
+// (a plain yaYUL image still works but is copied into RAM), its snapshot
+// and the profile at fixed addresses.
 const uint8_t *rom =  (const uint8_t *)0x10100000;
-const uint8_t *core =  (const uint8_t *)0x1020000;
-const uint8_t *profile =  (const uint8_t *)0x1030000;
+#define ROM_IMAGE_SIZE 0x100000
+const uint8_t *core =  (const uint8_t *)0x10200000;
+#define CORE_IMAGE_SIZE 0x100000
+#define CORE_FLASH_OFFSET (0x10200000 - XIP_BASE)
+const uint8_t *profile_image = (const uint8_t *)0x10300000;
+#define PROFILE_IMAGE_SIZE 0x100000
+
+// The fixed-fixed banks 2 and 3 and their rows of the predecoded table are
+// read from SRAM instead of flash.
+static int16_t       fixed_fixed[2][02000];
+static agc_decoded_t fixed_fixed_decoded[2][02000];
+
+// Flash the running program's snapshot is saved to.
+static uint32_t core_flash_offset = CORE_FLASH_OFFSET;
+static uint32_t core_flash_size   = CORE_IMAGE_SIZE;
+
+// Snapshots are saved this often; a flash sector survives about 100000
+// erase cycles, so this is kept well above the desktop default.
+#define CORE_DUMP_SECONDS 60
+
+// How long the program selection waits for a key before it starts the
+// first program.
+#define SELECT_TIMEOUT_US 3000000
+
+static profile_t profile;
+
+// About twenty seconds of frames to rewind to over the serial console.
+static history_t history;
+static uint8_t   history_buffer[32 * 1024];
+
+// Latest display contents, published by the engine core in dsky_refresh()
+// and drawn by core 1. Only the newest state matters for the display, so a
+// sequence counter (odd while a copy is in progress) replaces a queue.
+static struct
+{
+  atomic_uint seq;
+  dsky_t      dsky;
+} display;
+
+static bool display_take(unsigned* last_seq, dsky_t* dsky)
+{
+  unsigned seq;
+  do
+  {
+    seq = atomic_load_explicit(&display.seq, memory_order_acquire);
+    if(seq == *last_seq || (seq & 1))
+      return false;
+    *dsky = display.dsky;
+    atomic_thread_fence(memory_order_acquire);
+  } while(seq != atomic_load_explicit(&display.seq, memory_order_relaxed));
+
+  *last_seq = seq;
+  return true;
+}
+
+// The displays are redrawn at most this often; changes in between are
+// folded into the next frame.
+#define DISPLAY_FRAME_US 20000
 
+// Core 1 owns the SPI bus and the PIO: it refreshes the MAX7221 and WS2812
+// displays and scans the keyboard, so the engine on core 0 never waits for
+// a transfer.
 void core1_entry() {
+  unsigned seq        = 0;
+  uint64_t next_frame = 0;
+  dsky_t   dsky;
+
+  // Lets core 0 park this core while it writes a snapshot to flash.
+  flash_safe_execute_core_init();
+
+  // The DMA completion interrupt has to run on this core, with the
+  // devices it talks to.
+  spi_queue_init(spi_default);
+  init_indicator_display();
+  init_numeric_display();
+  init_keyboard();
+
   while (true) {
-    // Core 1 work here
-    printf("Core 1 running\n");
-    sleep_ms(1000);
+    uint64_t now = time_us_64();
+    if(now >= next_frame && display_take(&seq, &dsky))
+    {
+      refresh_numeric_display(&dsky);
+      refresh_indicator_display(&dsky);
+      next_frame = now + DISPLAY_FRAME_US;
+    }
+    keyboard_poll();
+  }
+}
+
+// Lets the operator pick the program of a catalog on the DSKY: PROG shows
+// its number and NOUN how many there are, + and - or a digit change it and
+// ENTR or PRO starts it. The first program starts if no key is pressed
+// within SELECT_TIMEOUT_US.
+static int select_program(const catalog_header_t *catalog)
+{
+  if(catalog->count == 1)
+    return 0;
+
+  dsky_t dsky;
+  dsky_init(&dsky);
+  dsky.noun.first  = catalog->count / 10;
+  dsky.noun.second = catalog->count % 10;
+
+  int      index    = 0;
+  bool     waiting  = true;
+  uint64_t deadline = time_us_64() + SELECT_TIMEOUT_US;
+  while(!waiting || time_us_64() < deadline)
+  {
+    dsky.prog.first  = (index + 1) / 10;
+    dsky.prog.second = (index + 1) % 10;
+    dsky_refresh(&dsky);
+
+    packet_t packet;
+    if(!keyboard_take(&packet))
+    {
+      sleep_ms(10);
+      continue;
+    }
+    waiting = false;
+    if(packet.channel == 032)
+    {
+      if(!packet.value)
+        break;
+      continue;
+    }
+    if(packet.value == KEY_ENTER)
+      break;
+    else if(packet.value == KEY_PLUS)
+      index = (index + 1) % catalog->count;
+    else if(packet.value == KEY_MINUS)
+      index = (index + catalog->count - 1) % catalog->count;
+    else if(packet.value >= KEY_ONE && packet.value <= KEY_NINE && packet.value <= catalog->count)
+      index = packet.value - KEY_ONE;
   }
+  return index;
 }
 
 int main(int argc, char* argv[])
@@ -39,28 +183,109 @@ int main(int argc, char* argv[])
   gpio_set_dir(OE_PIN, GPIO_OUT);
   gpio_put(OE_PIN, 1); // Set GPIO 22 HIGH
 
-  init_indicator_display();
-  init_numeric_display();
-  init_keyboard();
-
-  //multicore_reset_core1();
-  //multicore_launch_core1(core1_entry);
+  multicore_reset_core1();
+  multicore_launch_core1(core1_entry);
 
-  profile_load_file(profile, 25383);
   opt_t opt = {0};
+  opt.dump_time = CORE_DUMP_SECONDS;
   sim_t sim;
-  agc_load_rom(&sim.state, rom, 73728);
+  int error;
+  const catalog_header_t *catalog = catalog_map(catalog_image, CATALOG_IMAGE_SIZE);
+  if(catalog)
+  {
+    int index = select_program(catalog);
+    const catalog_entry_t *entry = &catalog->entries[index];
+    printf("Starting %s\n", entry->name);
+    error = catalog_select(catalog, index, &sim.state, &profile);
+    core              = catalog_data(catalog, &entry->core);
+    core_flash_offset = CATALOG_FLASH_OFFSET + entry->core.offset;
+    core_flash_size   = entry->core.size;
+  }
+  else
+  {
+    error = agc_map_rom(&sim.state, rom, ROM_IMAGE_SIZE);
+    if(error)
+      error = agc_load_rom(&sim.state, rom, 73728);
+    profile_map(&profile, profile_image, PROFILE_IMAGE_SIZE);
+  }
+  if(error)
+    printf("No usable ROM in flash (error %d)\n", error);
+  if(!profile.header.rows)
+    printf("No flight profile in flash\n");
+  agc_cache_rom_banks(&sim.state, 2, 2, fixed_fixed, fixed_fixed_decoded);
   init_sim(&sim, &opt);
-  agc_engine_init(&sim.state, core, 73728, 0);
+  sim.flight.profile = &profile;
+  agc_engine_init(&sim.state, NULL, 0, 0);
+  if(!core || snapshot_load(&sim.state, &sim.dsky, &sim.flight, core, core_flash_size))
+    printf("No snapshot in flash, starting from power-on\n");
+  history_init(&history, history_buffer, sizeof(history_buffer));
+  sim.history = &history;
   sim_exec(&sim);
 
   return (0);
 }
 
+// Collects a snapshot into flash pages, erasing each sector as it is reached.
+typedef struct
+{
+  uint32_t offset;
+  uint32_t end;
+  uint32_t fill;
+  uint8_t  page[FLASH_PAGE_SIZE];
+} flash_writer_t;
+
+static void flash_writer_page(flash_writer_t* writer)
+{
+  if(writer->offset % FLASH_SECTOR_SIZE == 0)
+    flash_range_erase(writer->offset, FLASH_SECTOR_SIZE);
+  flash_range_program(writer->offset, writer->page, FLASH_PAGE_SIZE);
+  writer->offset += FLASH_PAGE_SIZE;
+  writer->fill    = 0;
+}
+
+static bool flash_writer_write(void* context, const void* data, uint32_t len)
+{
+  flash_writer_t* writer = context;
+  const uint8_t*  bytes  = data;
+
+  if(writer->offset + writer->fill + len > writer->end)
+    return false;
+  while(len--)
+  {
+    writer->page[writer->fill++] = *bytes++;
+    if(writer->fill == FLASH_PAGE_SIZE)
+      flash_writer_page(writer);
+  }
+  return true;
+}
+
+static void flash_save(void* param)
+{
+  sim_t*         sim    = param;
+  flash_writer_t writer = {.offset = core_flash_offset, .end = core_flash_offset + core_flash_size};
+
+  if(snapshot_save(&sim->state, &sim->dsky, &sim->flight, flash_writer_write, &writer) && writer.fill)
+  {
+    memset(writer.page + writer.fill, 0xff, FLASH_PAGE_SIZE - writer.fill);
+    flash_writer_page(&writer);
+  }
+}
+
+void sim_save(sim_t* sim)
+{
+  // Flash cannot be read while it is written: core 1 is parked and
+  // interrupts are off until the snapshot is in place.
+  if(flash_safe_execute(flash_save, sim, 1000) != PICO_OK)
+    printf("Cannot save snapshot\n");
+}
+
 void dsky_refresh(dsky_t *dsky)
 {
-  refresh_numeric_display(dsky);
-  refresh_indicator_display(dsky);
+  unsigned seq = atomic_load_explicit(&display.seq, memory_order_relaxed);
+  atomic_store_explicit(&display.seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  display.dsky = *dsky;
+  atomic_store_explicit(&display.seq, seq + 2, memory_order_release);
 
   //dsky_print(dsky);
 }
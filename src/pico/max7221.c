@@ -12,6 +12,7 @@
 #include "pico/binary_info.h"
 #include "pico/stdlib.h"
 #include "spi.h"
+#include "spi_queue.h"
 
 /* Example code to talk to a Max7219 driving an 8 digit 7 segment display via SPI
 
@@ -38,6 +39,10 @@
 
 #define OE_PIN 22
 
+// The configuration registers are rewritten, and every digit resent, this
+// often in case a module dropped its state on a glitch.
+#define REINIT_INTERVAL_US 1000000
+
 const uint8_t CMD_NOOP        = 0;
 const uint8_t CMD_DIGIT0      = 1; // Goes up to 8, for each line
 const uint8_t CMD_DECODEMODE  = 9;
@@ -48,31 +53,47 @@ const uint8_t CMD_DISPLAYTEST = 15;
 
 
 #if defined(spi_default) && defined(PICO_DEFAULT_SPI_CSN_PIN)
-static void write_register_all(uint8_t reg, uint8_t data)
+// Queues one register write to every cascaded module. The transfer runs by
+// DMA; this only waits if the queue is full.
+static void submit_register(uint8_t reg, const uint8_t* data)
 {
-  uint8_t buf[2] = {reg, data};
-  cs_select(PICO_DEFAULT_SPI_CSN_PIN);
+  spi_transaction_t transaction = {.cs_pin = PICO_DEFAULT_SPI_CSN_PIN, .len = 2 * NUM_MODULES};
   for(int idx = 0; idx < NUM_MODULES; idx++)
   {
-    spi_write_blocking(spi_default, buf, 2);
+    transaction.tx[2 * idx]     = reg;
+    transaction.tx[2 * idx + 1] = data[idx];
   }
-  cs_deselect(PICO_DEFAULT_SPI_CSN_PIN);
+  while(!spi_queue_submit(&transaction))
+    tight_loop_contents();
+}
+
+static void write_register_all(uint8_t reg, uint8_t data)
+{
+  uint8_t all[NUM_MODULES];
+  memset(all, data, NUM_MODULES);
+  submit_register(reg, all);
 }
 
 static void write_register(uint8_t reg, uint8_t* data)
 {
-  uint8_t buf[2];
-  buf[0] = reg;
-  cs_select(PICO_DEFAULT_SPI_CSN_PIN);
-  for(int idx = 0; idx < NUM_MODULES; idx++)
-  {
-    buf[1] = data[idx];
-    spi_write_blocking(spi_default, buf, 2);
-  }
-  cs_deselect(PICO_DEFAULT_SPI_CSN_PIN);
+  submit_register(reg, data);
 }
 #endif
 
+// Digit registers as last sent to the modules, so that a refresh only
+// transmits the digit rows that changed.
+static uint8_t  digit_shadow[8][NUM_MODULES];
+static bool     digit_shadow_valid = false;
+static uint64_t next_reinit        = 0;
+
+static void write_digit(int digit, uint8_t* data)
+{
+  if(digit_shadow_valid && !memcmp(digit_shadow[digit], data, NUM_MODULES))
+    return;
+  write_register(CMD_DIGIT0 + digit, data);
+  memcpy(digit_shadow[digit], data, NUM_MODULES);
+}
+
 void hw_init_numeric_display()
 {
   write_register_all(CMD_DISPLAYTEST, 0);
@@ -84,7 +105,14 @@ void hw_init_numeric_display()
 
 void refresh_numeric_display(dsky_t *dsky)
 {
-  hw_init_numeric_display();
+  uint64_t now = time_us_64();
+  if(now >= next_reinit)
+  {
+    hw_init_numeric_display();
+    digit_shadow_valid = false;
+    next_reinit        = now + REINIT_INTERVAL_US;
+  }
+
   bool blink_on = !dsky->blink_off;
 
   uint8_t plus_encoding = 8;
@@ -94,28 +122,29 @@ void refresh_numeric_display(dsky_t *dsky)
   uint8_t third_sign = dsky->rows[2].plus ? plus_encoding : (dsky->rows[2].minus ? 10 : blank_encoding);
 
   uint8_t data0[3] = {third_sign, first_sign, dsky->prog.first};
-  write_register(CMD_DIGIT0 , data0);
+  write_digit(0, data0);
 
   uint8_t data1[3] = {dsky->rows[2].first, dsky->rows[0].first, dsky->prog.second};
-  write_register(CMD_DIGIT0 + 1, data1);
+  write_digit(1, data1);
 
   uint8_t data2[3] = {dsky->rows[2].second, second_sign, blink_on ? (uint8_t)dsky->noun.first : blank_encoding};
-  write_register(CMD_DIGIT0 + 2, data2);
+  write_digit(2, data2);
 
   uint8_t data3[3] = {dsky->rows[2].third, dsky->rows[1].first, blink_on ? (uint8_t)dsky->noun.second : blank_encoding};
-  write_register(CMD_DIGIT0 + 3, data3);
+  write_digit(3, data3);
 
   uint8_t data4[3] = {dsky->rows[2].fourth, dsky->rows[1].second, dsky->rows[0].fourth};
-  write_register(CMD_DIGIT0 + 4, data4);
+  write_digit(4, data4);
 
   uint8_t data5[3] = {dsky->rows[2].fifth, dsky->rows[1].third, dsky->rows[0].fifth};
-  write_register(CMD_DIGIT0 + 5, data5);
+  write_digit(5, data5);
 
   uint8_t data6[3] = {dsky->rows[1].fourth, blink_on ? (uint8_t)dsky->verb.first : blank_encoding, dsky->rows[0].second};
-  write_register(CMD_DIGIT0 + 6, data6);
+  write_digit(6, data6);
 
   uint8_t data7[3] = {dsky->rows[1].fifth, blink_on ? (uint8_t)dsky->verb.second : blank_encoding, dsky->rows[0].third};
-  write_register(CMD_DIGIT0 + 7, data7);
+  write_digit(7, data7);
+  digit_shadow_valid = true;
 }
 
 void clear()
@@ -124,6 +153,8 @@ void clear()
   {
     write_register_all(CMD_DIGIT0 + i, 15);
   }
+  memset(digit_shadow, 15, sizeof(digit_shadow));
+  digit_shadow_valid = true;
 }
 
 void init_spi_default()
@@ -152,4 +183,5 @@ void init_numeric_display()
 {
   hw_init_numeric_display();
   clear();
+  next_reinit = time_us_64() + REINIT_INTERVAL_US;
 }
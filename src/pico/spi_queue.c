@@ -0,0 +1,93 @@
+#include "spi_queue.h"
+
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "spi.h"
+
+static int               dma_tx;
+static int               dma_rx;
+static spi_transaction_t queue[SPI_QUEUE_LENGTH];
+static volatile int      queue_head   = 0; // Next free slot
+static volatile int      queue_tail   = 0; // Transaction on the bus, if any
+static volatile bool     queue_active = false;
+
+// Puts the transaction at queue_tail on the bus. Runs with the DMA
+// interrupt masked or from the interrupt itself.
+static void spi_queue_start(void)
+{
+  spi_transaction_t* transaction = &queue[queue_tail];
+
+  queue_active = true;
+  if(transaction->begin)
+    transaction->begin(transaction);
+  cs_select(transaction->cs_pin);
+
+  dma_channel_set_write_addr(dma_rx, transaction->rx, false);
+  dma_channel_set_trans_count(dma_rx, transaction->len, false);
+  dma_channel_set_read_addr(dma_tx, transaction->tx, false);
+  dma_channel_set_trans_count(dma_tx, transaction->len, false);
+  dma_start_channel_mask((1u << dma_tx) | (1u << dma_rx));
+}
+
+// The receive channel finishes last, once every byte has been clocked both
+// ways, so its completion ends the transaction.
+static void spi_queue_irq(void)
+{
+  if(!dma_channel_get_irq0_status(dma_rx))
+    return;
+  dma_channel_acknowledge_irq0(dma_rx);
+
+  spi_transaction_t* transaction = &queue[queue_tail];
+  cs_deselect(transaction->cs_pin);
+  if(transaction->done)
+    transaction->done(transaction);
+
+  queue_tail = (queue_tail + 1) % SPI_QUEUE_LENGTH;
+  if(queue_tail != queue_head)
+    spi_queue_start();
+  else
+    queue_active = false;
+}
+
+void spi_queue_init(spi_inst_t* spi)
+{
+  dma_tx = dma_claim_unused_channel(true);
+  dma_rx = dma_claim_unused_channel(true);
+
+  dma_channel_config config = dma_channel_get_default_config(dma_tx);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+  channel_config_set_dreq(&config, spi_get_dreq(spi, true));
+  channel_config_set_read_increment(&config, true);
+  channel_config_set_write_increment(&config, false);
+  dma_channel_configure(dma_tx, &config, &spi_get_hw(spi)->dr, NULL, 0, false);
+
+  config = dma_channel_get_default_config(dma_rx);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+  channel_config_set_dreq(&config, spi_get_dreq(spi, false));
+  channel_config_set_read_increment(&config, false);
+  channel_config_set_write_increment(&config, true);
+  dma_channel_configure(dma_rx, &config, NULL, &spi_get_hw(spi)->dr, 0, false);
+
+  dma_channel_set_irq0_enabled(dma_rx, true);
+  irq_add_shared_handler(DMA_IRQ_0, spi_queue_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_0, true);
+}
+
+bool spi_queue_submit(const spi_transaction_t* transaction)
+{
+  uint32_t irq  = save_and_disable_interrupts();
+  int      next = (queue_head + 1) % SPI_QUEUE_LENGTH;
+  bool     room = next != queue_tail;
+
+  if(room)
+  {
+    queue[queue_head] = *transaction;
+    queue_head        = next;
+    if(!queue_active)
+      spi_queue_start();
+  }
+
+  restore_interrupts(irq);
+  return room;
+}
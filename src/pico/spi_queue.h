@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/spi.h"
+
+// Largest transfer of a single transaction, in bytes.
+#define SPI_TRANSACTION_MAX 8
+// Transactions that can wait for the bus.
+#define SPI_QUEUE_LENGTH 16
+
+typedef struct spi_transaction spi_transaction_t;
+
+typedef void (*spi_callback_t)(spi_transaction_t* transaction);
+
+/**
+ * One chip-select framed transfer. tx is sent while rx is filled with what
+ * the device shifts back. begin runs just before chip select is asserted
+ * and done just after it is released, from the DMA interrupt; both may be
+ * NULL.
+ */
+struct spi_transaction
+{
+  uint           cs_pin;
+  uint8_t        len;
+  uint8_t        tx[SPI_TRANSACTION_MAX];
+  uint8_t        rx[SPI_TRANSACTION_MAX];
+  spi_callback_t begin;
+  spi_callback_t done;
+};
+
+/**
+ * Claims two DMA channels for spi and installs the completion interrupt on
+ * the calling core, which also runs all callbacks.
+ */
+void spi_queue_init(spi_inst_t* spi);
+
+/**
+ * Copies the transaction into the queue and returns at once, starting it if
+ * the bus is idle. Returns false if the queue is full.
+ */
+bool spi_queue_submit(const spi_transaction_t* transaction);
@@ -67,16 +67,32 @@ static uint offset;
 static int dma_chan;
 
 static uint32_t pixel_buffer[NUM_PIXELS] = {0};
+static bool     pixels_dirty             = true;
+
+// Words streamed into the PIO TX FIFO by dma_chan, already shifted the way
+// put_pixel() does; only rewritten while the channel is idle.
+static uint32_t dma_buffer[NUM_PIXELS];
 
 void set_pixel_color(uint index, uint32_t grb)
 {
+  if(pixel_buffer[index] == grb)
+    return;
   pixel_buffer[index] = grb;
+  pixels_dirty        = true;
 }
 
+// Starts streaming the pixels to the strip if any of them changed since the
+// last refresh. Returns without waiting for the transfer.
 void refresh_ws2812(PIO pio, uint sm, uint len) {
+  if(!pixels_dirty)
+    return;
+
+  dma_channel_wait_for_finish_blocking(dma_chan);
   for (uint i = 0; i < len; ++i) {
-    put_pixel(pio, sm, pixel_buffer[i]);
+    dma_buffer[i] = pixel_buffer[i] << 8u;
   }
+  pixels_dirty = false;
+  dma_channel_transfer_from_buffer_now(dma_chan, dma_buffer, len);
 }
 
 void init_indicator_display()
@@ -89,6 +105,16 @@ void init_indicator_display()
   hard_assert(success);
 
   ws2812_program_init(pio, sm, offset, WS2812_PIN, 800000, IS_RGBW);
+
+  dma_chan                  = dma_claim_unused_channel(true);
+  dma_channel_config config = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+  channel_config_set_read_increment(&config, true);
+  channel_config_set_write_increment(&config, false);
+  channel_config_set_dreq(&config, pio_get_dreq(pio, sm, true));
+  dma_channel_configure(dma_chan, &config, &pio->txf[sm], dma_buffer, 0, false);
+
+  pixels_dirty = true;
   refresh_ws2812(pio, sm, NUM_PIXELS);
 }
 
@@ -139,12 +165,14 @@ void refresh_indicator_display(dsky_t* dsky)
   for(size_t idx = 0; idx < 19; idx++)
     set_pixel_color(KY_BACKLIGHT + idx, white);
 
+  // Only reaches the strip if one of the pixels above changed.
   refresh_ws2812(pio, sm, NUM_PIXELS);
 }
 
 void deinit_indicator_display()
 {
   dma_channel_abort(dma_chan);
+  dma_channel_unclaim(dma_chan);
 
   pio_remove_program_and_unclaim_sm(&ws2812_program, pio, sm, offset);
 }
\ No newline at end of file